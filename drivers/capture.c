@@ -0,0 +1,134 @@
+#include "platform.h"
+#include "capture.h"
+#include "gpio.h"
+
+// Bits of Capture.seen
+#define SEEN_RISE 0x1
+#define SEEN_FALL 0x2
+#define SEEN_LAST 0x4
+
+int capture_init(Capture *capture, TimerHw *timer, uint32_t channel, Pin pin, uint32_t af,
+                 TimerHwEdge edge, uint32_t *buffer, uint32_t size) {
+	// Fails on a bad channel or size before anything is changed
+	if (!timer_hw_capture_dma_start(timer, channel, edge, buffer, size)) {
+		return 0;
+	}
+	capture->timer = timer;
+	capture->channel = channel;
+	capture->buffer = buffer;
+	capture->size = size;
+	capture->read = 0;
+	capture->period = timer_hw_period_ticks(timer);
+	capture->tick_rate = timer_hw_tick_rate(timer);
+	capture->counted = capture->period <= TIMER_HW_WRAP_PERIOD_MAX;
+	capture->edge = edge;
+	capture->seen = 0;
+	capture->time = 0;
+
+	gpio_set_alternate(pin, af);
+	// The level tells the direction of the first edge in TimerHwBoth
+	// mode; an edge right now may get its direction wrong
+	capture->level = gpio_get(pin) ? 1 : 0;
+	return 1;
+}
+
+void capture_stop(Capture *capture) {
+	timer_hw_channel_disable(capture->timer, capture->channel);
+}
+
+uint32_t capture_available(const Capture *capture) {
+	uint32_t write = timer_hw_capture_dma_position(capture->timer, capture->channel);
+
+	return (write + capture->size - capture->read) % capture->size;
+}
+
+int capture_read(Capture *capture, CaptureEdge *edge) {
+	uint32_t entry, previous;
+
+	if (capture_available(capture) == 0) {
+		return 0;
+	}
+	entry = capture->buffer[capture->read];
+	if (capture->counted) {
+		// The wraps after an edge are complete once the next one is in
+		previous = capture->buffer[(capture->read + capture->size - 1) % capture->size];
+		edge->ticks = TIMER_HW_CAPTURE_TICKS(entry);
+		edge->wraps = TIMER_HW_CAPTURE_WRAPS(previous);
+	} else {
+		edge->ticks = entry;
+		edge->wraps = 0;
+	}
+	capture->read = (capture->read + 1) % capture->size;
+	if (capture->edge == TimerHwBoth) {
+		capture->level = !capture->level; // the edges alternate
+		edge->rising = capture->level;
+	} else {
+		edge->rising = capture->edge == TimerHwRising;
+	}
+	return 1;
+}
+
+// Ticks from one edge's counter value to the next one's, wraps apart.
+// Without counted wraps the counter going backwards is the only sign
+// of one.
+static uint64_t capture_ticks(const Capture *capture, uint32_t from, uint32_t to, uint32_t wraps) {
+	if (to < from && wraps == 0) {
+		wraps = 1;
+	}
+	return (uint64_t)wraps * capture->period + to - from;
+}
+
+static uint32_t capture_us(const Capture *capture, uint64_t ticks) {
+	uint64_t us = ticks * 1000000 / capture->tick_rate;
+
+	return us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+uint32_t capture_interval_us(const Capture *capture, const CaptureEdge *from, const CaptureEdge *to) {
+	return capture_us(capture, capture_ticks(capture, from->ticks, to->ticks, to->wraps));
+}
+
+int capture_measure(Capture *capture, CaptureMeasurement *measurement) {
+	CaptureEdge edge;
+	uint32_t interval;
+	uint64_t ticks, period, *same;
+	uint8_t same_bit;
+	int first = 1;
+
+	measurement->edges = 0;
+	measurement->shortest_us = 0;
+	while (capture_read(capture, &edge)) {
+		if (capture->seen & SEEN_LAST) {
+			ticks = capture_ticks(capture, capture->last, edge.ticks, edge.wraps);
+			capture->time += ticks;
+			interval = capture_us(capture, ticks);
+			if (first || interval < measurement->shortest_us) {
+				measurement->shortest_us = interval;
+				first = 0;
+			}
+			// With both edges captured, the previous edge went the other way
+			if (capture->edge == TimerHwBoth) {
+				if (edge.rising) {
+					measurement->low_us = interval;
+				} else {
+					measurement->high_us = interval;
+				}
+			}
+		}
+		measurement->edges++;
+
+		same = edge.rising ? &capture->last_rise : &capture->last_fall;
+		same_bit = edge.rising ? SEEN_RISE : SEEN_FALL;
+		if (capture->seen & same_bit) {
+			period = capture->time - *same;
+			if (period) {
+				measurement->period_us = capture_us(capture, period);
+				measurement->frequency_millihz = (uint32_t)((uint64_t)capture->tick_rate * 1000 / period);
+			}
+		}
+		*same = capture->time;
+		capture->last = edge.ticks;
+		capture->seen |= same_bit | SEEN_LAST;
+	}
+	return measurement->edges != 0;
+}
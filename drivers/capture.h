@@ -0,0 +1,110 @@
+/*!
+ * \file      capture.h
+ * \brief     Edge timing with timer input capture.
+ *
+ * A timer channel latches its counter on every edge of its input and
+ * the DMA stores the values in a circular buffer, so the edges cost no
+ * interrupts and are timed by the hardware, not by interrupt latency.
+ * The functions here read the buffer back and turn the timestamps into
+ * pulse widths and frequencies.
+ *
+ * The timer's update interrupt counts the counter wraps between edges
+ * (see timer_hw_capture_dma_start()), so intervals may span many timer
+ * periods: a 16-bit timer at 1 MHz, timer_hw_init_us(timer, 65536, 0),
+ * times up to 71 minutes at 1 us resolution. Periods beyond 16 bits
+ * (TIM2 only) aren't counted and intervals are then taken modulo the
+ * period. The buffer must be read before it wraps onto unread edges.
+ */
+#ifndef CAPTURE_H
+#define CAPTURE_H
+#include <stdint.h>
+#include "timer_hw.h"
+
+/*! One captured edge. */
+typedef struct {
+	uint32_t ticks;  //!< Counter at the edge.
+	uint32_t wraps;  //!< Counter wraps since the previous edge.
+	uint8_t rising;  //!< True (1) for a rising edge, false (0) for a falling one.
+} CaptureEdge;
+
+/*! Timing of the most recent edges, updated by capture_measure().
+ *  Start from all zeros and keep it between calls; values not measured
+ *  yet stay 0.
+ */
+typedef struct {
+	uint32_t edges;             //!< Edges consumed by this call.
+	uint32_t shortest_us;       //!< Shortest time between two consecutive edges in this call (bounce).
+	uint32_t high_us;           //!< Width of the last high pulse (TimerHwBoth only).
+	uint32_t low_us;            //!< Width of the last low pulse (TimerHwBoth only).
+	uint32_t period_us;         //!< Time between the last two edges of the same direction.
+	uint32_t frequency_millihz; //!< 1 / period, in millihertz.
+} CaptureMeasurement;
+
+/*! An input capture channel and the state of its reader. Set up with
+ *  capture_init(); should not be modified directly.
+ */
+typedef struct {
+	TimerHw *timer;
+	uint32_t channel;
+	uint32_t *buffer;
+	uint32_t size;
+	uint32_t read;          // next entry to hand out
+	uint32_t period;        // counter period, in ticks
+	uint32_t tick_rate;     // counter ticks per second
+	TimerHwEdge edge;
+	uint8_t counted;        // wraps are counted in the buffer entries
+	uint8_t level;          // input level after the last edge handed out
+	uint8_t seen;           // bit 0: last_rise valid, bit 1: last_fall valid, bit 2: last valid
+	uint32_t last;          // counter at the last edge measured
+	uint64_t time;          // ticks from the first edge measured to the last
+	uint64_t last_rise;     // time of the last edges of each direction
+	uint64_t last_fall;
+} Capture;
+
+/*! \brief Starts capturing the edges of a pin. The timer must be set
+ *         up (timer_hw_init_us()) and running.
+ *  \param capture  Capture to set up.
+ *  \param timer    Timer, one of TIM1-TIM4.
+ *  \param channel  Channel of the pin, with a DMA request.
+ *  \param pin      Input pin of the channel.
+ *  \param af       Alternate function connecting pin to the channel.
+ *  \param edge     Edges to capture.
+ *  \param buffer   Storage for the timestamps.
+ *  \param size     Entries in buffer, 1 up to TIMER_HW_DMA_MAX_COUNT.
+ *  \return True (1) on success, false (0) if the channel can't do it
+ *          or size is out of range, in which case neither capture nor
+ *          the pin is touched.
+ */
+int capture_init(Capture *capture, TimerHw *timer, uint32_t channel, Pin pin, uint32_t af,
+                 TimerHwEdge edge, uint32_t *buffer, uint32_t size);
+
+/*! \brief Stops capturing. */
+void capture_stop(Capture *capture);
+
+/*! \brief Returns the amount of edges waiting to be read. */
+uint32_t capture_available(const Capture *capture);
+
+/*! \brief Takes the oldest waiting edge.
+ *  \param capture  Capture.
+ *  \param edge     Receives the edge.
+ *  \return True (1) if there was one, false (0) otherwise.
+ */
+int capture_read(Capture *capture, CaptureEdge *edge);
+
+/*! \brief Converts the time between two consecutive edges to
+ *         microseconds.
+ *  \param capture  Capture the edges come from.
+ *  \param from     Earlier edge.
+ *  \param to       Later edge.
+ *  \return Interval, in microseconds (rounded down, at most UINT32_MAX).
+ */
+uint32_t capture_interval_us(const Capture *capture, const CaptureEdge *from, const CaptureEdge *to);
+
+/*! \brief Consumes all waiting edges and updates their timing.
+ *  \param capture      Capture.
+ *  \param measurement  Timing to update.
+ *  \return True (1) if there were any edges, false (0) otherwise.
+ */
+int capture_measure(Capture *capture, CaptureMeasurement *measurement);
+
+#endif // CAPTURE_H
@@ -0,0 +1,154 @@
+#include "platform.h"
+#include "clock.h"
+#include "STM32F4xx_RCC.h"
+
+// TIM5 counts microseconds and is never stopped or reloaded. Channel 1
+// is the alarm, channel 2 samples the counters.
+#define CLOCK_TIM TIM5
+#define CLOCK_IRQ TIM5_IRQn
+
+// Wrap-around safe "a is before b"
+#define BEFORE(a, b) ((int32_t)((a) - (b)) < 0)
+
+static uint32_t us_high, us_last;       // wraps of TIM5, last CNT seen
+static uint32_t cycles_high, cycles_last; // wraps of CYCCNT, last CYCCNT seen
+static uint8_t started;
+static void (*alarm_callback)(void) = 0;
+
+// Both read with interrupts masked, so the last values are consistent
+static uint64_t extend_us(void) {
+	uint32_t now = CLOCK_TIM->CNT;
+
+	if (now < us_last) {
+		us_high++;
+	}
+	us_last = now;
+	return (uint64_t)us_high << 32 | now;
+}
+
+static uint64_t extend_cycles(void) {
+	uint32_t now = DWT->CYCCNT;
+
+	if (now < cycles_last) {
+		cycles_high++;
+	}
+	cycles_last = now;
+	return (uint64_t)cycles_high << 32 | now;
+}
+
+void clock_init(void) {
+	RCC_ClocksTypeDef clocks;
+	uint32_t clock, count = 0;
+	uint32_t primask = __get_PRIMASK();
+
+	// APB1 timers run at twice PCLK1 whenever APB1 is divided down
+	RCC_GetClocksFreq(&clocks);
+	clock = clocks.PCLK1_Frequency == clocks.HCLK_Frequency ? clocks.PCLK1_Frequency : 2 * clocks.PCLK1_Frequency;
+
+	__disable_irq();
+	if (started) {
+		count = (uint32_t)extend_us(); // carry on from here
+	} else {
+		// The cycle counter may already be in use (queue statistics),
+		// so it is left running rather than cleared
+		CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+		us_high = us_last = 0;
+		cycles_high = 0;
+		cycles_last = DWT->CYCCNT;
+	}
+
+	RCC->APB1ENR |= RCC_APB1ENR_TIM5EN;
+	CLOCK_TIM->CR1 = 0;
+	CLOCK_TIM->PSC = clock / 1000000 - 1; // 1 MHz
+	CLOCK_TIM->ARR = 0xFFFFFFFF;          // the full 32 bits
+	CLOCK_TIM->CCMR1 = 0;                 // channels 1 and 2: frozen output compare
+	CLOCK_TIM->DIER &= TIM_DIER_CC1IE;    // an armed alarm stays armed
+	CLOCK_TIM->EGR = TIM_EGR_UG;          // load PSC
+	CLOCK_TIM->CNT = count;
+	CLOCK_TIM->CCR2 = count + CLOCK_SAMPLE_US;
+	CLOCK_TIM->SR = 0;
+	CLOCK_TIM->DIER |= TIM_DIER_CC2IE;
+	if ((CLOCK_TIM->DIER & TIM_DIER_CC1IE) && !BEFORE(count, CLOCK_TIM->CCR1)) {
+		CLOCK_TIM->EGR = TIM_EGR_CC1G; // went off while we were away
+	}
+	CLOCK_TIM->CR1 = TIM_CR1_CEN;
+	started = 1;
+	__set_PRIMASK(primask);
+
+	NVIC_SetPriority(CLOCK_IRQ, 2); // below the button and the UART, above the LED blinking
+	NVIC_EnableIRQ(CLOCK_IRQ);
+}
+
+uint64_t clock_now_us(void) {
+	uint32_t primask = __get_PRIMASK();
+	uint64_t now;
+
+	__disable_irq();
+	now = extend_us();
+	__set_PRIMASK(primask);
+	return now;
+}
+
+uint64_t clock_now_cycles(void) {
+	uint32_t primask = __get_PRIMASK();
+	uint64_t now;
+
+	__disable_irq();
+	now = extend_cycles();
+	__set_PRIMASK(primask);
+	return now;
+}
+
+int clock_is_running(void) {
+	return started;
+}
+
+uint32_t clock_now_us32(void) {
+	return CLOCK_TIM->CNT;
+}
+
+void clock_alarm_set_callback(void (*callback)(void)) {
+	alarm_callback = callback;
+}
+
+// If the deadline has already passed, the compare would only match
+// after the counter wraps, so the interrupt is raised by hand
+void clock_alarm_set(uint32_t deadline_us) {
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	CLOCK_TIM->CCR1 = deadline_us;
+	CLOCK_TIM->SR = ~TIM_SR_CC1IF;
+	CLOCK_TIM->DIER |= TIM_DIER_CC1IE;
+	if (!BEFORE(CLOCK_TIM->CNT, deadline_us)) {
+		CLOCK_TIM->EGR = TIM_EGR_CC1G;
+	}
+	__set_PRIMASK(primask);
+}
+
+void clock_alarm_cancel(void) {
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	CLOCK_TIM->DIER &= ~TIM_DIER_CC1IE;
+	CLOCK_TIM->SR = ~TIM_SR_CC1IF;
+	__set_PRIMASK(primask);
+}
+
+void TIM5_IRQHandler(void) {
+	uint32_t sr = CLOCK_TIM->SR & CLOCK_TIM->DIER;
+
+	if (sr & TIM_SR_CC2IF) {
+		CLOCK_TIM->SR = ~TIM_SR_CC2IF;
+		CLOCK_TIM->CCR2 += CLOCK_SAMPLE_US;
+		clock_now_us();
+		clock_now_cycles();
+	}
+	if (sr & TIM_SR_CC1IF) {
+		CLOCK_TIM->SR = ~TIM_SR_CC1IF;
+		if (alarm_callback) {
+			alarm_callback();
+		}
+	}
+}
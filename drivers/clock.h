@@ -0,0 +1,70 @@
+/*!
+ * \file      clock.h
+ * \brief     Monotonic 64-bit microsecond and cycle clock.
+ *
+ * TIM5 counts microseconds freely over its full 32 bits and the DWT
+ * cycle counter counts core cycles. Both are extended to 64 bits in
+ * software: every read compares the counter with the last value seen
+ * and adds a wrap when it went backwards. A compare interrupt on TIM5
+ * channel 2 reads both every CLOCK_SAMPLE_US, so no wrap goes unseen
+ * even when nobody asks for the time. TIM5 is reserved for the clock.
+ *
+ * Channel 1 of TIM5 is offered as an alarm, which the software timers
+ * (swtimer.h) use to wake up at their next deadline.
+ *
+ * The time can be read from the main loop and from any interrupt.
+ */
+#ifndef CLOCK_H
+#define CLOCK_H
+#include <stdint.h>
+
+/*! Interval between the samples that extend the counters, in
+ *  microseconds. Must be shorter than a DWT wrap (about 43 s at
+ *  100 MHz).
+ */
+#ifndef CLOCK_SAMPLE_US
+#define CLOCK_SAMPLE_US 10000000UL
+#endif
+
+/*! \brief Starts the clock (TIM5 at 1 MHz and the DWT cycle counter).
+ *  Call once at start-up, and again after changing the APB1 clock:
+ *  the time then carries on from where it was.
+ */
+void clock_init(void);
+
+/*! \brief Checks if clock_init() has run.
+ *  \return True (1) if the clock is running, false (0) otherwise.
+ */
+int clock_is_running(void);
+
+/*! \brief Returns the time since clock_init(), in microseconds. */
+uint64_t clock_now_us(void);
+
+/*! \brief Returns the core cycles counted by the DWT cycle counter,
+ *         extended to 64 bits. Across clock changes these are cycles
+ *         at whatever the clock was.
+ */
+uint64_t clock_now_cycles(void);
+
+/*! \brief Returns the low 32 bits of clock_now_us(). Cheaper, and
+ *         enough for intervals shorter than about 71 minutes.
+ */
+uint32_t clock_now_us32(void);
+
+/*! \brief Sets the function called (from the TIM5 interrupt) when the
+ *         alarm goes off.
+ *  \param callback  Function to call, or 0 for none.
+ */
+void clock_alarm_set_callback(void (*callback)(void));
+
+/*! \brief Arms the alarm. If the time has already passed, it goes off
+ *         right away.
+ *  \param deadline_us  Low 32 bits of the time to go off at, at most
+ *                      about 35 minutes ahead.
+ */
+void clock_alarm_set(uint32_t deadline_us);
+
+/*! \brief Disarms the alarm. */
+void clock_alarm_cancel(void);
+
+#endif // CLOCK_H
@@ -1,7 +1,12 @@
 #include "platform.h"
 #include "comparator.h"
+#include "sleep.h"
 #include <stdlib.h>
 
+// Time for the ADC input to settle between the two reads, about what
+// the empty 1000-iteration loop used to take at 16 MHz
+#define COMPARATOR_SETTLE_US 250
+
 //Note: the interrupt can be only triggered once!
 void comparator_init(void) {
 	adc_init(P_CMP_NEG);	
@@ -11,8 +16,8 @@ void comparator_init(void) {
 
 int comparator_read(void) {	
 	uint16_t comp_neg = ( adc_read(P_CMP_NEG) & (uint16_t)0x0FFF) ;			
-	//Create some delay
-	for (int i=0; i < 1000;i++);
+	//Create some delay, sleeping rather than spinning
+	sleep_us(COMPARATOR_SETTLE_US);
 	
 	uint16_t comp_pos = ( adc_read(P_CMP_PLUS) & (uint16_t)0x0FFF) ;
 	if (comp_pos > comp_neg) {
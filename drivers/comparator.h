@@ -39,6 +39,12 @@ void comparator_set_trigger(ComparatorTriggerMode trig);
  */
 void comparator_set_callback(void (*callback)(int state));
 
+/*! \brief Reads the current value of the comparator. Sleeps about
+ *         250 us between its two ADC reads, with sleep_us(), which
+ *         busy-waits instead in an interrupt or before the clock and
+ *         the software timers are started.
+ *  \return Output value of the comparator.
+ */
 int comparator_read(void);
 
 #endif // COMPARATOR_H
@@ -1,30 +1,82 @@
 #include "platform.h"
 #include <stdint.h>
 #include "delay.h"
+#include "clock.h"
 
+// Longest single wait, well clear of the counter's 32-bit wrap
+#define DELAY_MAX_STEP 0x80000000UL
 
-extern void delay_cycles(unsigned int cycles);
+// The counter is shared (clock.h, queue statistics), so it is only
+// ever started here, never cleared
+static void delay_start_counter(void) {
+	if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+		CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	}
+}
 
-void delay_ms(unsigned int ms) {
-	unsigned int max_step = 1000 * (UINT32_MAX / SystemCoreClock);
-	unsigned int max_sleep_cycles = max_step * (SystemCoreClock / 1000);
-	while (ms > max_step) {
-		ms -= max_step;
-		delay_cycles(max_sleep_cycles);
+void delay_cycles(uint32_t cycles) {
+	uint32_t start;
+
+	delay_start_counter();
+	start = DWT->CYCCNT;
+	// Elapsed time, so interrupts taken meanwhile don't add to it
+	while (DWT->CYCCNT - start < cycles) {
 	}
-	delay_cycles(ms * (SystemCoreClock / 1000));
 }
 
-void delay_us(unsigned int us) {
-	unsigned int max_step = 1000000 * (UINT32_MAX / SystemCoreClock);
-	unsigned int max_sleep_cycles = max_step * (SystemCoreClock / 1000000);
-	while (us > max_step) {
-		us -= max_step;
-		delay_cycles(max_sleep_cycles);
+static void delay_cycles_long(uint64_t cycles) {
+	while (cycles > DELAY_MAX_STEP) {
+		delay_cycles(DELAY_MAX_STEP);
+		cycles -= DELAY_MAX_STEP;
 	}
-	delay_cycles(us * (SystemCoreClock / 1000000));
+	delay_cycles((uint32_t)cycles);
+}
+
+// Rounded up, so a delay is never shorter than asked
+void delay_ms(unsigned int ms) {
+	delay_cycles_long(((uint64_t)ms * SystemCoreClock + 999) / 1000);
+}
+
+void delay_us(unsigned int us) {
+	delay_cycles_long(((uint64_t)us * SystemCoreClock + 999999) / 1000000);
 }
 
+void delay_ns(unsigned int ns) {
+	delay_cycles_long(((uint64_t)ns * SystemCoreClock + 999999999) / 1000000000);
+}
+
+int delay_self_test(DelayCalibration *result) {
+	uint32_t start, end, cycles;
+	uint32_t primask = __get_PRIMASK();
+
+	delay_start_counter();
 
+	// Cost of the call itself, in cycles
+	start = DWT->CYCCNT;
+	delay_cycles(0);
+	result->overhead_cycles = DWT->CYCCNT - start;
+
+	// delay_us() against the clock's timer, which doesn't depend on
+	// SystemCoreClock being right
+	__disable_irq();
+	start = clock_now_us32();
+	cycles = DWT->CYCCNT;
+	delay_us(DELAY_TEST_US);
+	cycles = DWT->CYCCNT - cycles;
+	end = clock_now_us32();
+	__set_PRIMASK(primask);
+
+	result->requested_us = DELAY_TEST_US;
+	result->measured_us = end - start;
+	if (result->measured_us == 0) {
+		result->core_clock = 0; // the clock isn't running
+		result->error_ppm = -1000000;
+		return 0;
+	}
+	result->core_clock = (uint32_t)((uint64_t)cycles * 1000000 / result->measured_us);
+	result->error_ppm = (int32_t)(((int64_t)result->measured_us - DELAY_TEST_US) * 1000000 / DELAY_TEST_US);
+	return result->error_ppm <= DELAY_TOLERANCE_PPM && result->error_ppm >= -DELAY_TOLERANCE_PPM;
+}
 
 // *******************************ARM University Program Copyright © ARM Ltd 2016*************************************
@@ -5,6 +5,34 @@
  */
 #ifndef DELAY_H
 #define DELAY_H
+#include <stdint.h>
+
+/*! Length of the delay_self_test() measurement, in microseconds. */
+#ifndef DELAY_TEST_US
+#define DELAY_TEST_US 100000
+#endif
+
+/*! Largest error, in parts per million, that delay_self_test() accepts.
+ *  The clock's timer alone reads to 1 us, 10 ppm of DELAY_TEST_US.
+ */
+#ifndef DELAY_TOLERANCE_PPM
+#define DELAY_TOLERANCE_PPM 1000
+#endif
+
+/*! Result of delay_self_test(). */
+typedef struct {
+	uint32_t requested_us;    //!< Delay asked of delay_us().
+	uint32_t measured_us;     //!< Delay measured by the clock's timer (TIM5).
+	int32_t error_ppm;        //!< (measured - requested) / requested, in parts per million.
+	uint32_t core_clock;      //!< Core clock measured against TIM5, in Hz; should match SystemCoreClock.
+	uint32_t overhead_cycles; //!< Cycles taken by a call of delay_cycles(0).
+} DelayCalibration;
+
+/* The delays count core cycles on the DWT cycle counter, derived from
+ * SystemCoreClock, and are never shorter than asked. They measure
+ * elapsed time, so interrupts taken during a delay only lengthen it if
+ * they are still running when it ends.
+ */
 
 /*! \brief Delays for a duration milliseconds.
  *  \param ms   Duration to delay in milliseconds.
@@ -16,9 +44,23 @@ void delay_ms(unsigned int ms);
  */
 void delay_us(unsigned int us);
 
+/*! \brief Delays for a duration in nanoseconds, rounded up to whole
+ *         core cycles (62.5 ns at 16 MHz).
+ *  \param ns   Duration to delay in nanoseconds.
+ */
+void delay_ns(unsigned int ns);
+
 /*! \brief Delays for \a cycles.
  *  \param cycles   Cycles to delay for.
  */
-//void delay_cycles(unsigned int cycles);
+void delay_cycles(uint32_t cycles);
+
+/*! \brief Checks delay_us() against the clock's timer (clock.h), which
+ *         must be running. Takes DELAY_TEST_US with interrupts masked.
+ *  \param result  Receives the measurements.
+ *  \return True (1) if the delay is within DELAY_TOLERANCE_PPM, false
+ *          (0) otherwise (SystemCoreClock is probably wrong).
+ */
+int delay_self_test(DelayCalibration *result);
 
 #endif // DELAY_H
@@ -0,0 +1,53 @@
+#include "platform.h"
+#include "event.h"
+
+void event_queue_init(EventQueue *queue) {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	
+	queue->head = 0;
+	queue->tail = 0;
+	queue->dropped = 0;
+}
+
+int event_post(EventQueue *queue, uint32_t id, uint32_t payload) {
+	uint32_t primask = __get_PRIMASK();
+	uint32_t tail;
+	Event *event;
+	
+	// Posters may pre-empt each other, so claiming and filling a slot
+	// is done with interrupts masked. This is a fixed handful of
+	// instructions.
+	__disable_irq();
+	tail = queue->tail;
+	if (tail - queue->head == queue->size) {
+		queue->dropped++;
+		__set_PRIMASK(primask);
+		return 0;
+	}
+	event = &queue->data[tail & queue->mask];
+	event->id = id;
+	event->payload = payload;
+	event->timestamp = DWT->CYCCNT;
+	__DMB(); // the record must be visible before the consumer sees the new tail
+	queue->tail = tail + 1;
+	__set_PRIMASK(primask);
+	return 1;
+}
+
+int event_get(EventQueue *queue, Event *event) {
+	uint32_t head = queue->head;
+	
+	if (queue->tail == head) {
+		return 0;
+	}
+	__DMB(); // don't read the record before the tail that published it
+	*event = queue->data[head & queue->mask];
+	__DMB(); // finish reading the slot before handing it back to the posters
+	queue->head = head + 1;
+	return 1;
+}
+
+int event_queue_is_empty(EventQueue *queue) {
+	return queue->tail == queue->head;
+}
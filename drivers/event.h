@@ -0,0 +1,76 @@
+/*!
+ * \file      event.h
+ * \brief     Implements a queue of fixed-size event records.
+ *
+ * Lets interrupt handlers hand work over to the main loop. Any number
+ * of ISRs (at any priority) may post; a single context, normally the
+ * main loop, takes events out. Posting and taking are constant time.
+ */
+#ifndef EVENT_H
+#define EVENT_H
+#include <stdint.h>
+#include "queue.h"
+
+/*! A single event record. */
+typedef struct {
+	uint32_t id;        //!< Application-defined event identifier.
+	uint32_t payload;   //!< Event argument.
+	uint32_t timestamp; //!< DWT cycle count at the time the event was posted.
+} Event;
+
+/*! This structure encapsulates the event queue.
+ *  It should not be modified directly. Any modifications should
+ *  be carried out by the functions provided by event.h.
+ */
+typedef struct {
+	Event* data;            //!< Array of event records.
+	volatile uint32_t head; //!< Free-running read index, written only by the consumer.
+	volatile uint32_t tail; //!< Free-running write index, written by the posters.
+	uint32_t size;          //!< Size of the data array (a power of two).
+	uint32_t mask;          //!< size - 1, wraps an index into the data array.
+	uint32_t dropped;       //!< Events rejected because the queue was full.
+} EventQueue;
+
+/*! \brief Defines an event queue named \a name together with its
+ *         storage in .bss.
+ *  \param name  Name of the EventQueue variable.
+ *  \param size  Amount of events; must be a power of two.
+ */
+#define EVENT_QUEUE_DEFINE(name, size) \
+	static Event name##_data[QUEUE_CHECKED_SIZE(size)]; \
+	EventQueue name = { name##_data, 0, 0, (size), (size) - 1, 0 }
+
+/*! \brief Empties the queue and starts the DWT cycle counter the
+ *         time stamps come from. Must be called before the first
+ *         event_post().
+ *  \param queue  Event queue to operate on.
+ */
+void event_queue_init(EventQueue *queue);
+
+/*! \brief Posts an event to the back of the queue.
+ *  Safe to call from any interrupt priority and from the main loop.
+ *  The event is time-stamped with the DWT cycle counter.
+ *  \param queue    Event queue to operate on.
+ *  \param id       Identifier of the event.
+ *  \param payload  Argument of the event.
+ *  \return True (1) if the event was queued, false (0) if the queue
+ *          was full.
+ */
+int event_post(EventQueue *queue, uint32_t id, uint32_t payload);
+
+/*! \brief Takes the oldest event out of the queue.
+ *  Only a single context may call this.
+ *  \param queue  Event queue to operate on.
+ *  \param event  Pointer the event should be stored to, if successful.
+ *  \return True (1) if an event was taken, false (0) if the queue
+ *          was empty.
+ */
+int event_get(EventQueue *queue, Event *event);
+
+/*! \brief Checks if the supplied event queue is empty.
+ *  \param queue  Event queue to operate on.
+ *  \return True (1) if the queue is empty, false (0) otherwise.
+ */
+int event_queue_is_empty(EventQueue *queue);
+
+#endif // EVENT_H
@@ -0,0 +1,188 @@
+#include "format.h"
+
+#define FORMAT_LEFT 0x1 // '-' flag, pad on the right
+#define FORMAT_ZERO 0x2 // '0' flag, pad numbers with zeros
+
+typedef struct {
+	char *data;
+	uint32_t size;
+	uint32_t length;
+} FormatString;
+
+static const char digits_lower[] = "0123456789abcdef";
+static const char digits_upper[] = "0123456789ABCDEF";
+
+static void format_pad(FormatSink sink, void *context, char c, uint32_t count) {
+	char pad[8];
+	uint32_t i, chunk;
+
+	for (i = 0; i < sizeof(pad); i++) {
+		pad[i] = c;
+	}
+	while (count > 0) {
+		chunk = count < sizeof(pad) ? count : sizeof(pad);
+		sink(context, pad, chunk);
+		count -= chunk;
+	}
+}
+
+// Outputs a field: sign (if any), padding and text
+static uint32_t format_field(FormatSink sink, void *context, uint32_t flags, uint32_t width,
+                             char sign, const char *text, uint32_t length) {
+	uint32_t total = length + (sign ? 1 : 0);
+	uint32_t padding = width > total ? width - total : 0;
+
+	if (!(flags & (FORMAT_LEFT | FORMAT_ZERO))) {
+		format_pad(sink, context, ' ', padding);
+	}
+	if (sign) {
+		sink(context, &sign, 1);
+	}
+	if ((flags & (FORMAT_LEFT | FORMAT_ZERO)) == FORMAT_ZERO) {
+		format_pad(sink, context, '0', padding);
+	}
+	sink(context, text, length);
+	if (flags & FORMAT_LEFT) {
+		format_pad(sink, context, ' ', padding);
+	}
+	return total + padding;
+}
+
+uint32_t format_v(FormatSink sink, void *context, const char *format, va_list args) {
+	char number[10]; // 2^32 - 1 has ten decimal digits
+	const char *start;
+	const char *conversion;
+	const char *digits;
+	const char *text;
+	uint32_t written = 0;
+	uint32_t flags, width, length, value, base;
+	int32_t signed_value;
+	char sign, c;
+
+	while (*format) {
+		// Literal text up to the next conversion goes out in one piece
+		start = format;
+		while (*format && *format != '%') {
+			format++;
+		}
+		if (format != start) {
+			sink(context, start, format - start);
+			written += format - start;
+		}
+		if (!*format) {
+			break;
+		}
+		conversion = format++; // skip the '%'
+
+		flags = 0;
+		for (;; format++) {
+			if (*format == '-') {
+				flags |= FORMAT_LEFT;
+			} else if (*format == '0') {
+				flags |= FORMAT_ZERO;
+			} else {
+				break;
+			}
+		}
+		width = 0;
+		while (*format >= '0' && *format <= '9') {
+			width = width * 10 + (*format++ - '0');
+		}
+		if (*format == 'l') {
+			format++;
+		}
+
+		sign = 0;
+		base = 10;
+		digits = digits_lower;
+		switch (*format) {
+			case 'c':
+				c = (char)va_arg(args, int);
+				written += format_field(sink, context, flags & FORMAT_LEFT, width, 0, &c, 1);
+				format++;
+				continue;
+			case 's':
+				text = va_arg(args, const char *);
+				for (length = 0; text[length]; length++);
+				written += format_field(sink, context, flags & FORMAT_LEFT, width, 0, text, length);
+				format++;
+				continue;
+			case 'd':
+			case 'i':
+				signed_value = va_arg(args, int32_t);
+				if (signed_value < 0) {
+					sign = '-';
+					value = 0u - (uint32_t)signed_value;
+				} else {
+					value = (uint32_t)signed_value;
+				}
+				break;
+			case 'u':
+				value = va_arg(args, uint32_t);
+				break;
+			case 'X':
+				digits = digits_upper;
+				// fall through
+			case 'x':
+				base = 16;
+				value = va_arg(args, uint32_t);
+				break;
+			case '%':
+				sink(context, format, 1);
+				written++;
+				format++;
+				continue;
+			default:
+				// Unknown conversion (or the end of the string): output it as is
+				if (*format) {
+					format++;
+				}
+				sink(context, conversion, format - conversion);
+				written += format - conversion;
+				continue;
+		}
+		format++;
+
+		// Convert the number from the least significant digit backwards
+		length = 0;
+		do {
+			number[sizeof(number) - 1 - length++] = digits[value % base];
+			value /= base;
+		} while (value);
+		written += format_field(sink, context, flags, width, sign,
+		                        &number[sizeof(number) - length], length);
+	}
+	return written;
+}
+
+static void format_string_sink(void *context, const char *data, uint32_t length) {
+	FormatString *string = context;
+
+	while (length-- > 0) {
+		if (string->length + 1 < string->size) {
+			string->data[string->length] = *data;
+		}
+		string->length++;
+		data++;
+	}
+}
+
+uint32_t format_string_v(char *buffer, uint32_t size, const char *format, va_list args) {
+	FormatString string = { buffer, size, 0 };
+
+	format_v(format_string_sink, &string, format, args);
+	if (size > 0) {
+		buffer[string.length < size ? string.length : size - 1] = '\0';
+	}
+	return string.length;
+}
+
+uint32_t format_string(char *buffer, uint32_t size, const char *format, ...) {
+	uint32_t length;
+	va_list args;
+
+	va_start(args, format);
+	length = format_string_v(buffer, size, format, args);
+	va_end(args);
+	return length;
+}
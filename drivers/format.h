@@ -0,0 +1,57 @@
+/*!
+ * \file      format.h
+ * \brief     Small printf-style formatter.
+ *
+ * Supports the conversions %c, %d, %i, %u, %x, %X, %s and %%, each with
+ * an optional '-' or '0' flag and a field width (for example "%08x" or
+ * "%-6s"). The 'l' length modifier is accepted and ignored, as long and
+ * int have the same size here. Floating point is not supported.
+ *
+ * Nothing is allocated and no intermediate string is built: literal
+ * text is passed to the output function in place and numbers are
+ * converted in a few bytes of stack, so it may be used from interrupt
+ * handlers.
+ */
+#ifndef FORMAT_H
+#define FORMAT_H
+#include <stdint.h>
+#include <stdarg.h>
+
+/*! \brief Receives the formatted output, one piece at a time.
+ *  \param context  Pointer given to format_v().
+ *  \param data     Characters to output; not null-terminated.
+ *  \param length   Amount of characters.
+ */
+typedef void (*FormatSink)(void *context, const char *data, uint32_t length);
+
+/*! \brief Formats \a format with the arguments in \a args.
+ *  \param sink     Function the output is passed to.
+ *  \param context  Passed on to \a sink.
+ *  \param format   Format string.
+ *  \param args     Arguments of the conversions.
+ *  \return Amount of characters output.
+ */
+uint32_t format_v(FormatSink sink, void *context, const char *format, va_list args);
+
+/*! \brief Formats into a string, like snprintf().
+ *  \param buffer  Array the null-terminated result is stored to.
+ *  \param size    Size of buffer; the output is truncated to size - 1
+ *                 characters.
+ *  \param format  Format string.
+ *  \return Amount of characters the whole output would take, without
+ *          the null terminator.
+ */
+uint32_t format_string(char *buffer, uint32_t size, const char *format, ...);
+
+/*! \brief Formats into a string, like vsnprintf().
+ *  \param buffer  Array the null-terminated result is stored to.
+ *  \param size    Size of buffer; the output is truncated to size - 1
+ *                 characters.
+ *  \param format  Format string.
+ *  \param args    Arguments of the conversions.
+ *  \return Amount of characters the whole output would take, without
+ *          the null terminator.
+ */
+uint32_t format_string_v(char *buffer, uint32_t size, const char *format, va_list args);
+
+#endif // FORMAT_H
@@ -0,0 +1,159 @@
+#include "frame.h"
+
+typedef struct {
+	uint8_t *out;
+	uint32_t length;     // bytes stored to out
+	uint32_t code_index; // where the code byte of the current block goes
+	uint8_t code;        // 1 + data bytes in the current block
+} CobsEncoder;
+
+// CRC-16/CCITT-FALSE (polynomial 0x1021), a nibble at a time
+static const uint16_t crc_table[16] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+static uint16_t crc_update(uint16_t crc, uint8_t byte) {
+	crc = (crc << 4) ^ crc_table[(crc >> 12) ^ (byte >> 4)];
+	crc = (crc << 4) ^ crc_table[(crc >> 12) ^ (byte & 0x0F)];
+	return crc;
+}
+
+uint16_t frame_crc(const uint8_t *data, uint32_t length) {
+	uint16_t crc = 0xFFFF;
+
+	while (length-- > 0) {
+		crc = crc_update(crc, *data++);
+	}
+	return crc;
+}
+
+static void cobs_put(CobsEncoder *cobs, uint8_t byte) {
+	if (byte != 0) {
+		cobs->out[cobs->length++] = byte;
+		cobs->code++;
+	}
+	// A zero, or a full block, ends the current block
+	if (byte == 0 || cobs->code == 0xFF) {
+		cobs->out[cobs->code_index] = cobs->code;
+		cobs->code_index = cobs->length++;
+		cobs->code = 1;
+	}
+}
+
+uint32_t frame_encode(uint8_t type, const uint8_t *payload, uint32_t length, uint8_t *out) {
+	CobsEncoder cobs;
+	uint16_t crc = 0xFFFF;
+	uint32_t i;
+
+	if (length > FRAME_MAX_PAYLOAD) {
+		return 0;
+	}
+	out[0] = 0; // leading delimiter, ends any noise or text before the frame
+	cobs.out = out;
+	cobs.code_index = 1;
+	cobs.length = 2;
+	cobs.code = 1;
+
+	crc = crc_update(crc, type);
+	cobs_put(&cobs, type);
+	crc = crc_update(crc, (uint8_t)length);
+	cobs_put(&cobs, (uint8_t)length);
+	for (i = 0; i < length; i++) {
+		crc = crc_update(crc, payload[i]);
+		cobs_put(&cobs, payload[i]);
+	}
+	cobs_put(&cobs, (uint8_t)crc);
+	cobs_put(&cobs, (uint8_t)(crc >> 8));
+
+	out[cobs.code_index] = cobs.code;
+	out[cobs.length++] = 0;
+	return cobs.length;
+}
+
+void frame_receiver_init(FrameReceiver *rx) {
+	rx->length = 0;
+	rx->code = 0;
+	rx->left = 0;
+	rx->discard = 0;
+	rx->ready = 0;
+	rx->frames = 0;
+	rx->errors = 0;
+	rx->dropped = 0;
+}
+
+// Checks the frame that just ended, returns true if it is valid
+static int frame_check(FrameReceiver *rx) {
+	uint32_t length = rx->length;
+
+	if (rx->discard || rx->left != 0 || length < 4 || rx->data[1] != length - 4) {
+		return 0;
+	}
+	return frame_crc(rx->data, length - 2) ==
+	       (rx->data[length - 2] | (uint16_t)rx->data[length - 1] << 8);
+}
+
+int frame_receive(FrameReceiver *rx, uint8_t byte) {
+	if (rx->ready) {
+		rx->dropped++;
+		return 0;
+	}
+
+	if (byte == 0) {
+		// Delimiter: an empty frame (as between two delimiters) is not an error
+		if (rx->code != 0 || rx->discard) {
+			if (frame_check(rx)) {
+				rx->frames++;
+				rx->ready = 1;
+			} else {
+				rx->errors++;
+			}
+		}
+		rx->length = 0;
+		rx->code = 0;
+		rx->left = 0;
+		rx->discard = 0;
+		return rx->ready;
+	}
+	if (rx->discard) {
+		return 0;
+	}
+
+	if (rx->left == 0) {
+		// A code byte. Every block but a full one ends in an implicit zero
+		if (rx->code != 0 && rx->code != 0xFF) {
+			if (rx->length == sizeof(rx->data)) {
+				rx->discard = 1;
+				return 0;
+			}
+			rx->data[rx->length++] = 0;
+		}
+		rx->code = byte;
+		rx->left = byte - 1;
+	} else {
+		if (rx->length == sizeof(rx->data)) {
+			rx->discard = 1;
+			return 0;
+		}
+		rx->data[rx->length++] = byte;
+		rx->left--;
+	}
+	return 0;
+}
+
+int frame_ready(const FrameReceiver *rx) {
+	return rx->ready;
+}
+
+uint8_t frame_type(const FrameReceiver *rx) {
+	return rx->data[0];
+}
+
+const uint8_t *frame_payload(const FrameReceiver *rx, uint32_t *length) {
+	*length = rx->data[1];
+	return &rx->data[2];
+}
+
+void frame_release(FrameReceiver *rx) {
+	rx->ready = 0;
+}
@@ -0,0 +1,101 @@
+/*!
+ * \file      frame.h
+ * \brief     COBS framing with a CRC for binary messages over a UART.
+ *
+ * A frame carries a type byte, a length byte, up to FRAME_MAX_PAYLOAD
+ * bytes of payload and a CRC-16/CCITT-FALSE of the type, length and
+ * payload (little endian). This is COBS-encoded, so it contains no zero
+ * bytes, and sent between two zero delimiters:
+ *
+ *     00 | COBS(type length payload crc_lo crc_hi) | 00
+ *
+ * A receiver can pick up at any delimiter, and any corrupted frame
+ * fails its length or CRC check.
+ *
+ * Neither encoding nor decoding touches the hardware, so the same file
+ * builds into host tools (see tools/frametool.c).
+ */
+#ifndef FRAME_H
+#define FRAME_H
+#include <stdint.h>
+
+/*! Largest payload of a frame. */
+#define FRAME_MAX_PAYLOAD 255
+
+/*! Largest frame before encoding: type, length, payload and CRC. */
+#define FRAME_MAX_DECODED (2 + FRAME_MAX_PAYLOAD + 2)
+
+/*! Largest frame after encoding, including both delimiters. */
+#define FRAME_MAX_ENCODED (1 + 1 + FRAME_MAX_DECODED + FRAME_MAX_DECODED / 254 + 1)
+
+/*! This structure encapsulates a frame receiver.
+ *  It should not be modified directly. Any modifications should
+ *  be carried out by the functions provided by frame.h.
+ */
+typedef struct {
+	uint8_t data[FRAME_MAX_DECODED]; //!< The frame being received, decoded.
+	uint32_t length;                 //!< Decoded bytes in data.
+	uint8_t code;                    //!< Current COBS code byte, 0 before the first.
+	uint8_t left;                    //!< Bytes left in the current COBS block.
+	uint8_t discard;                 //!< Skip the rest of the current frame.
+	volatile uint8_t ready;          //!< A valid frame is waiting in data.
+	uint32_t frames;                 //!< Valid frames received.
+	uint32_t errors;                 //!< Frames rejected for their length, encoding or CRC.
+	uint32_t dropped;                //!< Bytes discarded while a frame was waiting.
+} FrameReceiver;
+
+/*! \brief Computes the CRC-16/CCITT-FALSE of a block of bytes.
+ *  \param data    Bytes to check.
+ *  \param length  Amount of bytes.
+ *  \return CRC of the bytes.
+ */
+uint16_t frame_crc(const uint8_t *data, uint32_t length);
+
+/*! \brief Builds an encoded frame, ready to be transmitted.
+ *  \param type     Type of the frame.
+ *  \param payload  Payload of the frame.
+ *  \param length   Length of the payload, at most FRAME_MAX_PAYLOAD.
+ *  \param out      Array of at least FRAME_MAX_ENCODED bytes the frame
+ *                  is stored to.
+ *  \return Amount of bytes stored to out, or 0 if length is too large.
+ */
+uint32_t frame_encode(uint8_t type, const uint8_t *payload, uint32_t length, uint8_t *out);
+
+/*! \brief Initialises a frame receiver.
+ *  \param rx  Receiver to initialise.
+ */
+void frame_receiver_init(FrameReceiver *rx);
+
+/*! \brief Feeds a received byte to the receiver.
+ *  Call this from the receive interrupt. While a frame is waiting
+ *  (frame_ready()), further bytes are dropped, so the sender should
+ *  wait for a reply before sending the next frame.
+ *  \param rx    Receiver to operate on.
+ *  \param byte  Received byte.
+ *  \return True (1) if the byte completed a valid frame, false (0)
+ *          otherwise.
+ */
+int frame_receive(FrameReceiver *rx, uint8_t byte);
+
+/*! \brief Checks if a valid frame is waiting.
+ *  \param rx  Receiver to operate on.
+ *  \return True (1) if a frame is waiting, false (0) otherwise.
+ */
+int frame_ready(const FrameReceiver *rx);
+
+/*! \brief Returns the type of the waiting frame. */
+uint8_t frame_type(const FrameReceiver *rx);
+
+/*! \brief Returns the payload of the waiting frame.
+ *  \param rx      Receiver to operate on.
+ *  \param length  Pointer the length of the payload is stored to.
+ *  \return Payload of the frame.
+ */
+const uint8_t *frame_payload(const FrameReceiver *rx, uint32_t *length);
+
+/*! \brief Discards the waiting frame, so the next one can be received.
+ *  \param rx  Receiver to operate on.
+ */
+void frame_release(FrameReceiver *rx);
+
+#endif // FRAME_H
@@ -128,6 +128,18 @@ void gpio_set_mode(Pin pin, PinMode mode) {
 	}
 }
 
+void gpio_set_alternate(Pin pin, uint32_t af) {
+	// Hands the pin over to a peripheral (push-pull, no pull resistor).
+	
+	GPIO_TypeDef* p = GET_PORT(pin);
+	uint32_t pin_index = GET_PIN_INDEX(pin);
+	RCC->AHB1ENR|=1UL<<GET_PORT_INDEX(pin);//enable clock output
+	
+	MODIFY_REG(p->AFR[pin_index>>3], 0xFUL<<((pin_index&7)*4), af<<((pin_index&7)*4));
+	MODIFY_REG(p->PUPDR, 3UL<<((pin_index)*2), 0UL<<((pin_index)*2));
+	MODIFY_REG(p->MODER, 3UL<<((pin_index)*2), 2UL<<((pin_index)*2));
+}
+
 void gpio_set_trigger(Pin pin, TriggerMode trig) {
 	// Sets the interrupt trigger for the specified pin.
 	
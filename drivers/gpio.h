@@ -72,6 +72,17 @@ unsigned int gpio_get_range(Pin pin_base, int count);
  */
 void gpio_set_mode(Pin pin, PinMode mode);
 
+/*! \brief Connects a GPIO pin to a peripheral.
+ *
+ *  The pin is switched to alternate function mode, which lets the
+ *  peripheral (a timer channel, a USART...) drive or read it.
+ *  gpio_get() still reads its level.
+ *
+ *  \param pin  Pin to set.
+ *  \param af   Alternate function number (0-15), from the datasheet.
+ */
+void gpio_set_alternate(Pin pin, uint32_t af);
+
 /*! \brief Configures the event which will cause an interrupt
  *         on a specified pin.
  *
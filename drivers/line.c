@@ -0,0 +1,75 @@
+#include "platform.h"
+#include "line.h"
+
+// Processes held characters until the queue runs dry or the line
+// completes. Runs either in the receive interrupt or with interrupts
+// masked, so it is never re-entered.
+static void line_process(Line *line) {
+	uint8_t c;
+
+	while (line->reading && queue_dequeue(line->input, &c)) {
+		if (c == LINE_BACKSPACE) {
+			if (line->length > 0) {
+				line->length--;
+				uart_port_write(line->port, &c, 1); // erase it on the terminal
+			}
+		} else if (c == LINE_TERMINATOR) {
+			uart_port_write(line->port, &c, 1);
+			line->overflow = 0;
+			line->reading = 0;
+		} else if (!line->filter || line->filter(c)) {
+			line->buffer[line->length++] = (char)c;
+			uart_port_write(line->port, &c, 1);
+			if (line->length == line->size - 1) {
+				line->overflow = 1;
+				line->reading = 0;
+			}
+		}
+
+		if (!line->reading) {
+			line->buffer[line->length] = '\0';
+			line->ready = 1;
+		}
+	}
+	uart_port_update_flow(line->port); // held input may have drained
+}
+
+void line_init(Line *line, UartPort *port, Queue *input,
+               char *buffer, uint32_t size, LineFilter filter) {
+	line->port = port;
+	line->input = input;
+	line->filter = filter;
+	line->buffer = buffer;
+	line->size = size;
+	line->length = 0;
+	line->reading = 0;
+	line->ready = 0;
+	line->overflow = 0;
+}
+
+void line_input(Line *line, const uint8_t *data, uint32_t length) {
+	queue_enqueue_n(line->input, data, length);
+	line_process(line);
+}
+
+void line_start(Line *line) {
+	uint32_t primask = __get_PRIMASK();
+
+	// The receive interrupt processes input as soon as reading is set,
+	// so the held characters are replayed with it masked
+	__disable_irq();
+	line->length = 0;
+	line->overflow = 0;
+	line->ready = 0;
+	line->reading = 1;
+	line_process(line);
+	__set_PRIMASK(primask);
+}
+
+int line_ready(const Line *line) {
+	return line->ready;
+}
+
+int line_pending(const Line *line) {
+	return !line->reading && !queue_is_empty(line->input);
+}
@@ -0,0 +1,89 @@
+/*!
+ * \file      line.h
+ * \brief     Line discipline for terminal input on a UART port.
+ *
+ * Received characters are fed in from the receive interrupt. While a
+ * line is being read they are filtered, echoed and edited there, so
+ * the application only needs to look at the input once per completed
+ * line. Characters received while no line is being read are held back
+ * and processed when the next line is started.
+ */
+#ifndef LINE_H
+#define LINE_H
+#include <stdint.h>
+#include "queue.h"
+#include "uart.h"
+
+/*! Character that erases the previous character. */
+#define LINE_BACKSPACE 0x7F
+
+/*! Character that completes a line. */
+#define LINE_TERMINATOR '\r'
+
+/*! \brief Decides which characters are stored in the line.
+ *  \param c  Received character.
+ *  \return True (1) to store and echo \a c, false (0) to ignore it.
+ */
+typedef int (*LineFilter)(uint8_t c);
+
+/*! This structure encapsulates a line discipline.
+ *  It should not be modified directly. Any modifications should
+ *  be carried out by the functions provided by line.h.
+ */
+typedef struct {
+	UartPort *port;          //!< Port characters are echoed to.
+	Queue *input;            //!< Received characters not yet processed.
+	LineFilter filter;       //!< Characters accepted into the line, or null for all.
+	char *buffer;            //!< The line, null-terminated once complete.
+	uint32_t size;           //!< Size of buffer, including the terminator.
+	uint32_t length;         //!< Characters in buffer.
+	volatile int reading;    //!< A line is being read.
+	volatile int ready;      //!< The line is complete.
+	int overflow;            //!< The line was completed because the buffer filled up.
+} Line;
+
+/*! \brief Initialises a line discipline. No line is read until
+ *         line_start() is called.
+ *  \param line    Line discipline to initialise.
+ *  \param port    Port echoed characters are written to.
+ *  \param input   Queue received characters are held in, sized for
+ *                 the input that may arrive between two lines.
+ *  \param buffer  Storage for the line.
+ *  \param size    Size of buffer; the longest line is size - 1.
+ *  \param filter  Characters accepted into the line, or null for all.
+ */
+void line_init(Line *line, UartPort *port, Queue *input,
+               char *buffer, uint32_t size, LineFilter filter);
+
+/*! \brief Feeds received characters to the line discipline.
+ *  Call this from the receive interrupt (for example a
+ *  UartRxChunkCallback). Characters are processed immediately while a
+ *  line is being read, and held otherwise.
+ *  \param line    Line discipline to operate on.
+ *  \param data    Received characters.
+ *  \param length  Amount of characters.
+ */
+void line_input(Line *line, const uint8_t *data, uint32_t length);
+
+/*! \brief Starts reading a new line. Characters held since the previous
+ *         line are processed first, so this may complete the line
+ *         straight away.
+ *  \param line  Line discipline to operate on.
+ */
+void line_start(Line *line);
+
+/*! \brief Checks if the line started with line_start() is complete.
+ *  Once it is, the buffer holds the null-terminated line without the
+ *  terminator and stays untouched until the next line_start().
+ *  \param line  Line discipline to operate on.
+ *  \return True (1) if the line is complete, false (0) otherwise.
+ */
+int line_ready(const Line *line);
+
+/*! \brief Checks if characters were received since the line completed.
+ *  \param line  Line discipline to operate on.
+ *  \return True (1) if characters are held, false (0) otherwise.
+ */
+int line_pending(const Line *line);
+
+#endif // LINE_H
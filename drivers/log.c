@@ -0,0 +1,61 @@
+#include "log.h"
+#include "format.h"
+#include "uart.h"
+#include <stdarg.h>
+
+static const char *const *log_formats;
+static uint32_t log_format_count;
+static LogMode log_mode;
+
+// Appends value + 1 as unsigned LEB128, returns the amount of bytes.
+// Only a value of 0 would end in a zero byte, and the offset rules it
+// out, so records never contain the frame delimiter of frame.h.
+static uint32_t log_encode(uint8_t *record, uint32_t value) {
+	uint64_t encoded = (uint64_t)value + 1; // 33 bits fit in 5 bytes
+	uint32_t length = 0;
+
+	while (encoded >= 0x80) {
+		record[length++] = (uint8_t)(encoded | 0x80);
+		encoded >>= 7;
+	}
+	record[length++] = (uint8_t)encoded;
+	return length;
+}
+
+static void log_sink(void *context, const char *data, uint32_t length) {
+	uart_write((const uint8_t *)data, length);
+}
+
+void log_init(const char *const *formats, uint32_t count, LogMode mode) {
+	log_formats = formats;
+	log_format_count = count;
+	log_mode = mode;
+}
+
+void log_set_mode(LogMode mode) {
+	log_mode = mode;
+}
+
+void log_message(uint32_t id, uint32_t count, ...) {
+	uint8_t record[1 + 5 * (1 + LOG_MAX_ARGS)]; // marker, id and arguments of 5 bytes at most
+	uint32_t length = 0;
+	va_list args;
+
+	if (count > LOG_MAX_ARGS) {
+		count = LOG_MAX_ARGS;
+	}
+	va_start(args, count);
+	if (log_mode == LogText) {
+		if (id < log_format_count) {
+			format_v(log_sink, 0, log_formats[id], args);
+		}
+	} else {
+		record[length++] = LOG_MARKER;
+		length += log_encode(&record[length], id);
+		while (count-- > 0) {
+			length += log_encode(&record[length], va_arg(args, uint32_t));
+		}
+		uart_write(record, length);
+	}
+	va_end(args);
+}
@@ -0,0 +1,59 @@
+/*!
+ * \file      log.h
+ * \brief     Tokenized logging over the console UART.
+ *
+ * Log messages are identified by a number that indexes a table of
+ * format strings shared with the host (see log_messages.h). In text
+ * mode the message is formatted on the target, as with uart_printf().
+ * In token mode only the number and the raw arguments are sent, and
+ * tools/logdecode rebuilds the text on the host from the same table.
+ *
+ * A token record is LOG_MARKER followed by the message number and each
+ * argument, each plus one and encoded as unsigned LEB128 (7 bits per
+ * byte, least significant first, top bit set on all but the last byte).
+ * The offset keeps every byte of a record non-zero, so records never
+ * contain the delimiter of the COBS frames (frame.h) sent on the same
+ * console. Text is 7-bit ASCII, so records and ordinary output can
+ * share the line.
+ *
+ * Format strings follow format.h, except that %s can't be used in
+ * token mode: the host can't follow a pointer into the target.
+ */
+#ifndef LOG_H
+#define LOG_H
+#include <stdint.h>
+
+/*! First byte of a token record. */
+#define LOG_MARKER 0xFF
+
+/*! Maximum amount of arguments of a log message. */
+#define LOG_MAX_ARGS 4
+
+/*! How log messages are sent. */
+typedef enum {
+	LogText,  //!< Formatted on the target.
+	LogTokens //!< Sent as a token record, formatted on the host.
+} LogMode;
+
+/*! \brief Sets the message table and the mode.
+ *  \param formats  Format string of each message, indexed by its number.
+ *  \param count    Amount of messages in formats.
+ *  \param mode     How messages are sent.
+ */
+void log_init(const char *const *formats, uint32_t count, LogMode mode);
+
+/*! \brief Changes how messages are sent.
+ *  \param mode  How messages are sent.
+ */
+void log_set_mode(LogMode mode);
+
+/*! \brief Logs a message. Safe to call from interrupt handlers.
+ *  A token record is written with a single uart_write(), so records
+ *  from different contexts never interleave.
+ *  \param id     Number of the message.
+ *  \param count  Amount of arguments that follow (at most LOG_MAX_ARGS),
+ *                each of which is converted to uint32_t.
+ */
+void log_message(uint32_t id, uint32_t count, ...);
+
+#endif // LOG_H
@@ -92,6 +92,8 @@ typedef enum {
 #define P_LED_R PA_5
 #define P_LED_G PA_6
 #define P_LED_B PA_7
+// Alternate function of P_LED_R that connects it to TIM2 channel 1.
+#define P_LED_R_AF_TIM2 1
 
 // Module 6: GPIOProjectSlideWhistle, GPIOLabBasicUI
 // Joystick control.
@@ -133,10 +135,15 @@ typedef enum {
 // Other pins (for documentation).
 #define P_ADC PA_0
 //#define P_DAC PA
+// The comparator inputs are also USART2's CTS (PA0) and RTS (PA1):
+// a build with CONSOLE_FLOW_CONTROL takes them over, so it can't use
+// the comparator.
 #define P_CMP_PLUS PA_1
 #define P_CMP_NEG PA_0
 #define P_RX PA_3
 #define P_TX PA_2
+#define P_CTS PA_0
+#define P_RTS PA_1
 #define P_SCL PB_8
 #define P_SDA PB_9
 
@@ -1,38 +1,192 @@
+#include "platform.h"
 #include "queue.h"
 #include <stdlib.h>
+#include <string.h>
+
+// Bookkeeping shared by the producer-side functions, called with the
+// number of items accepted and rejected by one operation.
+static void queue_account(Queue *queue, uint32_t accepted, uint32_t rejected) {
+	uint32_t count;
+	
+	if (accepted) {
+		count = queue->tail - queue->head;
+		if (count > queue->stats.high_watermark) {
+			queue->stats.high_watermark = count;
+		}
+		queue->stats.enqueued += accepted;
+		if (queue->full) {
+			queue->stats.full_cycles += DWT->CYCCNT - queue->full_since;
+			queue->full = 0;
+		}
+	}
+	if (rejected) {
+		queue->stats.dropped += rejected;
+		if (!queue->full) {
+			queue->full_since = DWT->CYCCNT;
+			queue->full = 1;
+		}
+	}
+}
 
 int queue_init(Queue *queue, uint32_t size) {
-	queue->data = (uint8_t*)malloc(sizeof(uint8_t) * size);
+	// Round the size up to a power of two so indices can be wrapped
+	// with a mask instead of a modulo.
+	uint32_t capacity = 1;
+	uint8_t *data;
+	
+	// Past 2^31 the capacity would wrap to 0 before reaching size
+	if (size > QUEUE_MAX_SIZE) {
+		return 0;
+	}
+	while (capacity < size) {
+		capacity <<= 1;
+	}
+	
+	// If malloc returns NULL (0) the allocation has failed.
+	data = (uint8_t*)malloc(sizeof(uint8_t) * capacity);
+	if (data == 0) {
+		return 0;
+	}
+	queue->data = data;
+	queue->head = 0;
+	queue->tail = 0;
+	queue->size = capacity;
+	queue->mask = capacity - 1;
+	queue_reset_stats(queue);
+	return 1;
+}
+
+int queue_init_static(Queue *queue, uint8_t *storage, uint32_t size) {
+	if (size == 0 || (size & (size - 1)) != 0) {
+		return 0;
+	}
+	queue->data = storage;
 	queue->head = 0;
 	queue->tail = 0;
 	queue->size = size;
-	
-	// If malloc returns NULL (0) the allocation has failed.
-	return queue->data != 0;
+	queue->mask = size - 1;
+	queue_reset_stats(queue);
+	return 1;
 }
 
 int queue_enqueue(Queue *queue, uint8_t item) {
-	if (!queue_is_full(queue)) {
-		queue->data[queue->tail++] = item;
-		queue->tail %= queue->size;
-		return 1;
-	} else {
+	uint32_t tail = queue->tail;
+	
+	if (tail - queue->head == queue->size) {
+		queue_account(queue, 0, 1);
 		return 0;
 	}
+	queue->data[tail & queue->mask] = item;
+	__DMB(); // the item must be visible before the consumer sees the new tail
+	queue->tail = tail + 1;
+	queue_account(queue, 1, 0);
+	return 1;
 }
 
 int queue_dequeue(Queue *queue, uint8_t *item) {
-	if (!queue_is_empty(queue)) {
-		*item = queue->data[queue->head++];
-		queue->head %= queue->size;
-		return 1;
-	} else {
+	uint32_t head = queue->head;
+	
+	if (queue->tail == head) {
 		return 0;
 	}
+	__DMB(); // don't read the item before the tail that published it
+	*item = queue->data[head & queue->mask];
+	__DMB(); // finish reading the slot before handing it back to the producer
+	queue->head = head + 1;
+	return 1;
+}
+
+uint32_t queue_enqueue_n(Queue *queue, const uint8_t *items, uint32_t count) {
+	uint32_t tail = queue->tail;
+	uint32_t space = queue->size - (tail - queue->head);
+	uint32_t index = tail & queue->mask;
+	uint32_t first;
+	uint32_t requested = count;
+	
+	if (count > space) {
+		count = space;
+	}
+	// Copy up to the end of the array, then wrap to the start.
+	first = queue->size - index;
+	if (first > count) {
+		first = count;
+	}
+	memcpy(&queue->data[index], items, first);
+	memcpy(queue->data, items + first, count - first);
+	__DMB();
+	queue->tail = tail + count;
+	queue_account(queue, count, requested - count);
+	return count;
+}
+
+uint32_t queue_dequeue_n(Queue *queue, uint8_t *items, uint32_t count) {
+	QueueSpan span;
+	uint32_t available = queue_peek_span(queue, &span);
+	uint32_t first = span.length[0];
+	
+	if (count > available) {
+		count = available;
+	}
+	if (first > count) {
+		first = count;
+	}
+	memcpy(items, span.data[0], first);
+	memcpy(items + first, span.data[1], count - first);
+	queue_consume(queue, count);
+	return count;
+}
+
+uint32_t queue_peek_span(Queue *queue, QueueSpan *span) {
+	uint32_t head = queue->head;
+	uint32_t count = queue->tail - head;
+	uint32_t index = head & queue->mask;
+	uint32_t first = queue->size - index;
+	
+	__DMB();
+	if (first > count) {
+		first = count;
+	}
+	span->data[0] = &queue->data[index];
+	span->length[0] = first;
+	span->data[1] = queue->data;
+	span->length[1] = count - first;
+	return count;
+}
+
+void queue_consume(Queue *queue, uint32_t count) {
+	__DMB();
+	queue->head += count;
+}
+
+uint32_t queue_count(Queue *queue) {
+	return queue->tail - queue->head;
+}
+
+void queue_get_stats(Queue *queue, QueueStats *stats) {
+	uint32_t primask = __get_PRIMASK();
+
+	// The producer may be an interrupt: don't let it tear the 64-bit count
+	__disable_irq();
+	*stats = queue->stats;
+	if (queue->full) {
+		stats->full_cycles += DWT->CYCCNT - queue->full_since;
+	}
+	__set_PRIMASK(primask);
+}
+
+void queue_reset_stats(Queue *queue) {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	
+	queue->stats.high_watermark = queue->tail - queue->head;
+	queue->stats.enqueued = 0;
+	queue->stats.dropped = 0;
+	queue->stats.full_cycles = 0;
+	queue->full = 0;
 }
 
 int queue_is_full(Queue *queue) {
-	return ((queue->tail + 1) % queue->size) == queue->head;
+	return (queue->tail - queue->head) == queue->size;
 }
 
 int queue_is_empty(Queue *queue) {
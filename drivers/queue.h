@@ -2,33 +2,107 @@
  * \file      queue.h
  * \brief     Implements a queue (FIFO) data structure.
  * \copyright ARM University Program &copy; ARM Ltd 2014.
+ *
+ * The queue is a lock-free single-producer / single-consumer ring.
+ * One context (e.g. an ISR) may enqueue while another (e.g. the main
+ * loop) dequeues without disabling interrupts. Several producers or
+ * several consumers must serialise among themselves.
  */
 #ifndef QUEUE_H
 #define QUEUE_H
 #include <stdint.h>
 
+/*! Occupancy and loss counters of a queue. All counters are
+ *  maintained by the producer.
+ */
+typedef struct {
+	uint32_t high_watermark; //!< Highest amount of items held at once.
+	uint32_t enqueued;       //!< Total items accepted.
+	uint32_t dropped;        //!< Total items rejected because the queue was full.
+	uint64_t full_cycles;    //!< CPU cycles from the first rejected item until the
+	                         //!< next accepted one, summed over every full episode.
+	                         //!< A single episode is timed with the 32-bit DWT
+	                         //!< counter, so one longer than 2^32 cycles (43 s at
+	                         //!< 100 MHz) is undercounted.
+} QueueStats;
+
 /*! This structure encapsulates the queue data structure.
  *  It should not be modified directly. Any modifications should
  *  be carried out by the functions provided by queue.h.
  */
 typedef struct {
-	uint8_t* data; //!< Array of data, stored on the heap.
-	uint32_t head; //!< Index in the array of the oldest element.
-	uint32_t tail; //!< Index in the array of the youngest element.
-	uint32_t size; //!< Size of the data array.
+	uint8_t* data;          //!< Array of data.
+	volatile uint32_t head; //!< Free-running read index, written only by the consumer.
+	volatile uint32_t tail; //!< Free-running write index, written only by the producer.
+	uint32_t size;          //!< Size of the data array (a power of two).
+	uint32_t mask;          //!< size - 1, wraps an index into the data array.
+	QueueStats stats;       //!< Instrumentation counters.
+	uint32_t full_since;    //!< Cycle count of the first rejected item of the current full episode.
+	uint32_t full;          //!< True (1) while a full episode is in progress.
 } Queue;
 
+/*! Up to two contiguous regions of a queue's contents, oldest first.
+ *  The second region is only used when the contents wrap around the
+ *  end of the data array.
+ */
+typedef struct {
+	const uint8_t* data[2]; //!< Start of each region.
+	uint32_t length[2];     //!< Amount of elements in each region.
+} QueueSpan;
+
+/*! Largest size queue_init() accepts (the largest power of two in 32 bits). */
+#define QUEUE_MAX_SIZE 0x80000000UL
+
+/*! Evaluates to \a size if it is a power of two, and to an invalid
+ *  (negative) array length otherwise, failing the build. The size is
+ *  taken as signed, so an unsigned one (100u) can't turn the -1 into
+ *  a huge valid length.
+ */
+#define QUEUE_CHECKED_SIZE(size) \
+	(((long)(size) > 0 && ((long)(size) & ((long)(size) - 1)) == 0) ? (long)(size) : -1L)
+
+/*! Static initialiser for a queue using \a storage of \a size elements. */
+#define QUEUE_INITIALISER(storage, size) \
+	{ (storage), 0, 0, (size), (size) - 1, { 0, 0, 0, 0 }, 0, 0 }
+
+/*! \brief Defines a queue named \a name together with its storage
+ *         in .bss. No call to queue_init() is needed.
+ *  \param name  Name of the Queue variable.
+ *  \param size  Amount of elements; must be a power of two.
+ */
+#define QUEUE_DEFINE(name, size) \
+	static uint8_t name##_data[QUEUE_CHECKED_SIZE(size)]; \
+	Queue name = QUEUE_INITIALISER(name##_data, size)
+
+/*! \brief As QUEUE_DEFINE(), but the queue is local to the file. */
+#define QUEUE_DEFINE_STATIC(name, size) \
+	static uint8_t name##_data[QUEUE_CHECKED_SIZE(size)]; \
+	static Queue name = QUEUE_INITIALISER(name##_data, size)
+
 /*! \brief Initialises the supplied queue structure to the
  *         parameterised size.
  *  This must be called before any use of the data-structure.
  *  \param queue Queue structure to operate on.
- *  \param size  Amount of elements the queue can hold.
+ *  \param size  Amount of elements the queue can hold. Rounded up
+ *               to the next power of two; at most QUEUE_MAX_SIZE.
  *  \return True (1) if the operation is successful, false (0)
- *          otherwise.
+ *          if \a size is too large or the allocation fails, in
+ *          which case the queue is left untouched.
  */
 int queue_init(Queue *queue, uint32_t size);
 
+/*! \brief Initialises the supplied queue structure on top of
+ *         caller-provided storage, without touching the heap.
+ *  \param queue   Queue structure to operate on.
+ *  \param storage Array of \a size elements backing the queue.
+ *  \param size    Amount of elements; must be a power of two.
+ *  \return True (1) if the operation is successful, false (0)
+ *          if \a size is not a power of two.
+ */
+int queue_init_static(Queue *queue, uint8_t *storage, uint32_t size);
+
 /*! \brief Adds an item to the back of the queue.
+ *  Wait-free; only the producer may call this.
  *  \param queue Queue structure to operate on.
  *  \param item  Item to add to the queue.
  *  \return True (1) if the operation is successful (i.e. the
@@ -37,6 +111,7 @@ int queue_init(Queue *queue, uint32_t size);
 int queue_enqueue(Queue *queue, uint8_t item);
 
 /*! \brief Removes the item at the front of the queue.
+ *  Wait-free; only the consumer may call this.
  *  \param queue Queue structure to operate on.
  *  \param item  Pointer to value the result should be stored,
  *               if successful.
@@ -45,6 +120,62 @@ int queue_enqueue(Queue *queue, uint8_t item);
  */
 int queue_dequeue(Queue *queue, uint8_t *item);
 
+/*! \brief Adds up to \a count items to the back of the queue.
+ *  Wait-free; only the producer may call this.
+ *  \param queue Queue structure to operate on.
+ *  \param items Items to add to the queue.
+ *  \param count Amount of items to add.
+ *  \return Amount of items added, less than \a count if the queue
+ *          filled up.
+ */
+uint32_t queue_enqueue_n(Queue *queue, const uint8_t *items, uint32_t count);
+
+/*! \brief Removes up to \a count items from the front of the queue.
+ *  Wait-free; only the consumer may call this.
+ *  \param queue Queue structure to operate on.
+ *  \param items Array the removed items are copied to.
+ *  \param count Maximum amount of items to remove.
+ *  \return Amount of items removed.
+ */
+uint32_t queue_dequeue_n(Queue *queue, uint8_t *items, uint32_t count);
+
+/*! \brief Exposes the queued items in place without removing them.
+ *  The regions stay valid until they are released with
+ *  queue_consume(). Only the consumer may call this.
+ *  \param queue Queue structure to operate on.
+ *  \param span  Filled with the regions holding the queued items.
+ *  \return Total amount of items in \a span.
+ */
+uint32_t queue_peek_span(Queue *queue, QueueSpan *span);
+
+/*! \brief Removes \a count items previously exposed by queue_peek_span().
+ *  \param queue Queue structure to operate on.
+ *  \param count Amount of items to remove. Must not exceed the total
+ *               returned by the last queue_peek_span().
+ */
+void queue_consume(Queue *queue, uint32_t count);
+
+/*! \brief Returns the amount of items in the queue.
+ *  \param queue Queue structure to operate on.
+ *  \return Amount of items currently queued.
+ */
+uint32_t queue_count(Queue *queue);
+
+/*! \brief Copies the instrumentation counters of the queue.
+ *  Cheap enough to call from the main loop at any time. A full
+ *  episode still in progress is included in \a full_cycles.
+ *  \param queue Queue structure to operate on.
+ *  \param stats Filled with the current counters.
+ */
+void queue_get_stats(Queue *queue, QueueStats *stats);
+
+/*! \brief Clears the instrumentation counters of the queue.
+ *  Also starts the DWT cycle counter used to time full episodes.
+ *  Updates made by the producer while this runs may be lost.
+ *  \param queue Queue structure to operate on.
+ */
+void queue_reset_stats(Queue *queue);
+
 /*! \brief Checks if the supplied queue is full.
  *  \param queue Queue structure to operate on.
  *  \return True (1) if the queue is full, false (0) otherwise.
@@ -0,0 +1,118 @@
+#include "platform.h"
+#include "sleep.h"
+#include "clock.h"
+#include "swtimer.h"
+#include "delay.h"
+
+// Longest busy-wait between two checks of the predicate while the
+// clock isn't running
+#define SLEEP_POLL_US 10
+
+static void sleep_wake(void *context) {
+	*(volatile int *)context = 1;
+}
+
+static int sleep_check(SleepPredicate predicate, void *context) {
+	return predicate && predicate(context);
+}
+
+uint64_t sleep_deadline_ms(uint32_t ms) {
+	return clock_now_us() + (uint64_t)ms * 1000;
+}
+
+void sleep_ms(uint32_t ms) {
+	if (!clock_is_running()) {
+		delay_ms(ms);
+		return;
+	}
+	sleep_until(sleep_deadline_ms(ms), 0, 0);
+}
+
+void sleep_us(uint32_t us) {
+	if (!clock_is_running()) {
+		delay_us(us);
+		return;
+	}
+	sleep_until(clock_now_us() + us, 0, 0);
+}
+
+// Without the clock the time can't be read, so the time left at the
+// start is counted down in delay_us() steps instead
+static int sleep_until_delay(uint64_t deadline_us, SleepPredicate predicate, void *context) {
+	uint64_t now = clock_now_us();
+	uint64_t left = deadline_us > now ? deadline_us - now : 0;
+	uint32_t step;
+
+	while (!sleep_check(predicate, context)) {
+		if (left == 0) {
+			return 0;
+		}
+		step = left < SLEEP_POLL_US ? (uint32_t)left : SLEEP_POLL_US;
+		delay_us(step);
+		if (deadline_us != SLEEP_FOREVER) {
+			left -= step;
+		}
+	}
+	return 1;
+}
+
+int sleep_until(uint64_t deadline_us, SleepPredicate predicate, void *context) {
+	SwTimer timer;
+	volatile int expired = 1; // no timer running yet
+	uint64_t now, step;
+	int ready;
+
+	if (!clock_is_running()) {
+		return sleep_until_delay(deadline_us, predicate, context);
+	}
+
+	// In an interrupt, with interrupts masked, or without the software
+	// timer service, nothing would wake us
+	if (__get_IPSR() != 0 || __get_PRIMASK() || !swtimer_service_is_running()) {
+		while (!(ready = sleep_check(predicate, context)) && clock_now_us() < deadline_us) {
+		}
+		return ready;
+	}
+
+	swtimer_init(&timer, sleep_wake, (void *)&expired);
+	while (1) {
+		if (sleep_check(predicate, context)) {
+			ready = 1;
+			break;
+		}
+		now = clock_now_us();
+		if (now >= deadline_us) {
+			ready = 0;
+			break;
+		}
+		if (expired) {
+			// Far deadlines are reached in several steps
+			step = deadline_us - now;
+			if (step > SWTIMER_MAX_US) {
+				step = SWTIMER_MAX_US;
+			}
+			expired = 0;
+			if (!swtimer_start_us(&timer, (uint32_t)step, 0)) {
+				expired = 1; // no timer free: poll instead
+				continue;
+			}
+		}
+
+		// Wait for Interrupt, unless the wait ended meanwhile
+		// (a pending interrupt still wakes __WFI with interrupts masked)
+		__disable_irq();
+		if (!expired && !sleep_check(predicate, context)) {
+			__WFI();
+		}
+		__enable_irq();
+	}
+	swtimer_stop(&timer); // the timer lives on this stack frame
+	return ready;
+}
+
+AwaitResult await_until(uint64_t deadline_us, SleepPredicate predicate, void *context) {
+	if (sleep_check(predicate, context)) {
+		return AwaitReady;
+	}
+	return clock_now_us() >= deadline_us ? AwaitTimeout : AwaitPending;
+}
@@ -0,0 +1,75 @@
+/*!
+ * \file      sleep.h
+ * \brief     Waiting without burning the CPU.
+ *
+ * sleep_ms(), sleep_us() and sleep_until() park the caller in __WFI
+ * until a software timer (swtimer.h) expires at the deadline, so
+ * interrupts keep being served and the core idles in the meantime.
+ * await_until() never blocks: it tells a polling loop whether to carry
+ * on waiting.
+ *
+ * Deadlines are absolute times on the clock (clock_now_us()). Called
+ * from an interrupt, with interrupts masked, or before
+ * swtimer_service_init(), nothing can wake the caller, so the waits
+ * fall back to busy-waiting on the clock. Before clock_init() they
+ * busy-wait with delay_us() (delay.h) instead, checking the predicate
+ * every few microseconds; await_until() needs the clock.
+ */
+#ifndef SLEEP_H
+#define SLEEP_H
+#include <stdint.h>
+
+/*! Deadline that never passes. */
+#define SLEEP_FOREVER UINT64_MAX
+
+/*! Condition waited for. Becomes true through an interrupt (or, for
+ *  await_until(), through whatever else the polling loop does).
+ *  \param context  As passed to the waiting function.
+ *  \return True (non-zero) once the wait is over.
+ */
+typedef int (*SleepPredicate)(void *context);
+
+/*! What await_until() found. */
+typedef enum {
+	AwaitPending, //!< Neither yet: keep waiting.
+	AwaitReady,   //!< The predicate holds.
+	AwaitTimeout  //!< The deadline passed first.
+} AwaitResult;
+
+/*! \brief Returns the deadline a duration from now.
+ *  \param ms  Duration, in milliseconds.
+ *  \return Deadline, in clock_now_us() time.
+ */
+uint64_t sleep_deadline_ms(uint32_t ms);
+
+/*! \brief Sleeps for a duration.
+ *  \param ms  Duration, in milliseconds.
+ */
+void sleep_ms(uint32_t ms);
+
+/*! \brief Sleeps for a duration.
+ *  \param us  Duration, in microseconds.
+ */
+void sleep_us(uint32_t us);
+
+/*! \brief Sleeps until a predicate holds or a deadline passes. The
+ *         predicate is checked with interrupts masked before each
+ *         sleep, so a wake-up can't be missed.
+ *  \param deadline_us  Deadline, in clock_now_us() time, or SLEEP_FOREVER.
+ *  \param predicate    Condition to wait for, or 0 to wait for the deadline.
+ *  \param context      Passed to predicate.
+ *  \return True (1) if the predicate holds, false (0) if the deadline
+ *          passed first.
+ */
+int sleep_until(uint64_t deadline_us, SleepPredicate predicate, void *context);
+
+/*! \brief Checks, without waiting, how a wait stands.
+ *  \param deadline_us  Deadline, in clock_now_us() time, or SLEEP_FOREVER.
+ *  \param predicate    Condition waited for, or 0 to wait for the deadline.
+ *  \param context      Passed to predicate.
+ *  \return AwaitReady if the predicate holds, AwaitTimeout if the
+ *          deadline has passed, AwaitPending otherwise.
+ */
+AwaitResult await_until(uint64_t deadline_us, SleepPredicate predicate, void *context);
+
+#endif // SLEEP_H
@@ -0,0 +1,165 @@
+#include "platform.h"
+#include "swtimer.h"
+#include "clock.h"
+
+// Running timers, heap[0] expires first
+static SwTimer *heap[SWTIMER_MAX];
+static uint32_t heap_size;
+static uint8_t started;
+
+// Wrap-around safe "a expires before b"
+#define BEFORE(a, b) ((int32_t)((a) - (b)) < 0)
+
+static void heap_place(SwTimer *timer, uint32_t index) {
+	heap[index] = timer;
+	timer->index = (int32_t)index;
+}
+
+static void heap_up(uint32_t index) {
+	SwTimer *timer = heap[index];
+	uint32_t parent;
+
+	while (index > 0) {
+		parent = (index - 1) / 2;
+		if (!BEFORE(timer->deadline, heap[parent]->deadline)) {
+			break;
+		}
+		heap_place(heap[parent], index);
+		index = parent;
+	}
+	heap_place(timer, index);
+}
+
+static void heap_down(uint32_t index) {
+	SwTimer *timer = heap[index];
+	uint32_t child;
+
+	while ((child = 2 * index + 1) < heap_size) {
+		if (child + 1 < heap_size && BEFORE(heap[child + 1]->deadline, heap[child]->deadline)) {
+			child++;
+		}
+		if (!BEFORE(heap[child]->deadline, timer->deadline)) {
+			break;
+		}
+		heap_place(heap[child], index);
+		index = child;
+	}
+	heap_place(timer, index);
+}
+
+// Takes a running timer out of the heap. Interrupts must be masked.
+static void heap_remove(SwTimer *timer) {
+	uint32_t index = (uint32_t)timer->index;
+	SwTimer *last = heap[--heap_size];
+
+	timer->index = -1;
+	if (last == timer) {
+		return;
+	}
+	heap_place(last, index);
+	heap_up(index);
+	heap_down((uint32_t)last->index);
+}
+
+// Points the clock alarm at the earliest deadline. Interrupts must be
+// masked.
+static void swtimer_program(void) {
+	if (heap_size == 0) {
+		clock_alarm_cancel(); // nothing to wake up for
+		return;
+	}
+	clock_alarm_set(heap[0]->deadline);
+}
+
+static void swtimer_expire(void);
+
+void swtimer_service_init(void) {
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	heap_size = 0;
+	clock_alarm_cancel();
+	clock_alarm_set_callback(swtimer_expire);
+	started = 1;
+	__set_PRIMASK(primask);
+}
+
+int swtimer_service_is_running(void) {
+	return started;
+}
+
+void swtimer_init(SwTimer *timer, void (*callback)(void *context), void *context) {
+	timer->callback = callback;
+	timer->context = context;
+	timer->period = 0;
+	timer->index = -1;
+}
+
+int swtimer_start(SwTimer *timer, uint32_t delay_ms, uint32_t period_ms) {
+	return swtimer_start_us(timer, delay_ms * 1000, period_ms * 1000);
+}
+
+int swtimer_start_us(SwTimer *timer, uint32_t delay_us, uint32_t period_us) {
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if (timer->index >= 0) {
+		heap_remove(timer);
+	}
+	if (heap_size == SWTIMER_MAX) {
+		__set_PRIMASK(primask);
+		return 0;
+	}
+	timer->deadline = clock_now_us32() + delay_us;
+	timer->period = period_us;
+	heap[heap_size] = timer;
+	heap_up(heap_size++);
+	swtimer_program();
+	__set_PRIMASK(primask);
+	return 1;
+}
+
+void swtimer_stop(SwTimer *timer) {
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if (timer->index >= 0) {
+		heap_remove(timer);
+		swtimer_program();
+	}
+	__set_PRIMASK(primask);
+}
+
+int swtimer_is_running(const SwTimer *timer) {
+	return timer->index >= 0;
+}
+
+uint32_t swtimer_now_us(void) {
+	return clock_now_us32();
+}
+
+// Runs from the clock alarm, in the TIM5 interrupt
+static void swtimer_expire(void) {
+	SwTimer *timer;
+
+	while (1) {
+		__disable_irq();
+		if (heap_size == 0 || BEFORE(clock_now_us32(), heap[0]->deadline)) {
+			swtimer_program();
+			__enable_irq();
+			break;
+		}
+		timer = heap[0];
+		if (timer->period) {
+			// Periodic: reschedule from the deadline, so it doesn't drift
+			timer->deadline += timer->period;
+			heap_down(0);
+		} else {
+			heap_remove(timer);
+		}
+		__enable_irq();
+
+		// The callback may start or stop any timer, this one included
+		timer->callback(timer->context);
+	}
+}
@@ -0,0 +1,100 @@
+/*!
+ * \file      swtimer.h
+ * \brief     Software timers multiplexed on a single hardware timer.
+ *
+ * Any number of one-shot and periodic timers (up to SWTIMER_MAX
+ * running at once) share one hardware timer. Running timers are kept
+ * in a binary min-heap ordered by deadline, so starting and stopping a
+ * timer is O(log n) and finding the next one to expire is O(1).
+ *
+ * The service is tickless: the clock alarm (clock.h, on TIM5) is
+ * pointed at the earliest deadline, so the only interrupts are the
+ * expiries themselves.
+ *
+ * Callbacks run in the TIM5 interrupt. Timers may be started and
+ * stopped from the main loop, from any interrupt and from callbacks.
+ */
+#ifndef SWTIMER_H
+#define SWTIMER_H
+#include <stdint.h>
+
+/*! Largest amount of timers running at the same time. */
+#ifndef SWTIMER_MAX
+#define SWTIMER_MAX 32
+#endif
+
+/*! Longest delay or period, in milliseconds (about 35 minutes, half
+ *  the range of the 32-bit microsecond counter).
+ */
+#define SWTIMER_MAX_MS (0x7FFFFFFFUL / 1000)
+
+/*! Longest delay or period, in microseconds. */
+#define SWTIMER_MAX_US 0x7FFFFFFFUL
+
+/*! A software timer. Allocated by the caller, set up with
+ *  swtimer_init(). It should not be modified directly.
+ */
+typedef struct {
+	uint32_t deadline;                //!< Time of the next expiry, in microseconds.
+	uint32_t period;                  //!< Microseconds between expiries, 0 for a one-shot timer.
+	void (*callback)(void *context);  //!< Called on expiry.
+	void *context;                    //!< Passed to callback.
+	int32_t index;                    //!< Position in the heap, -1 while stopped.
+} SwTimer;
+
+/*! \brief Sets up the service on the clock alarm, with no timer
+ *         running. Call once, after clock_init() and before starting
+ *         any timer.
+ */
+void swtimer_service_init(void);
+
+/*! \brief Checks if swtimer_service_init() has run.
+ *  \return True (1) if the service is running, false (0) otherwise.
+ */
+int swtimer_service_is_running(void);
+
+/*! \brief Sets up a timer. It starts out stopped.
+ *  \param timer     Timer to set up.
+ *  \param callback  Function called from the timer interrupt on expiry.
+ *  \param context   Passed to callback.
+ */
+void swtimer_init(SwTimer *timer, void (*callback)(void *context), void *context);
+
+/*! \brief Starts (or restarts) a timer.
+ *  \param timer      Timer to start.
+ *  \param delay_ms   Time until the first expiry, at most SWTIMER_MAX_MS.
+ *  \param period_ms  Time between later expiries (at most
+ *                    SWTIMER_MAX_MS), or 0 for a one-shot timer.
+ *  \return True (1) if the timer was started, false (0) if SWTIMER_MAX
+ *          timers are already running.
+ */
+int swtimer_start(SwTimer *timer, uint32_t delay_ms, uint32_t period_ms);
+
+/*! \brief Starts (or restarts) a timer, like swtimer_start(), with
+ *         times in microseconds.
+ *  \param timer      Timer to start.
+ *  \param delay_us   Time until the first expiry, at most SWTIMER_MAX_US.
+ *  \param period_us  Time between later expiries (at most
+ *                    SWTIMER_MAX_US), or 0 for a one-shot timer.
+ *  \return True (1) if the timer was started, false (0) if SWTIMER_MAX
+ *          timers are already running.
+ */
+int swtimer_start_us(SwTimer *timer, uint32_t delay_us, uint32_t period_us);
+
+/*! \brief Stops a timer. Does nothing if it isn't running.
+ *  \param timer  Timer to stop.
+ */
+void swtimer_stop(SwTimer *timer);
+
+/*! \brief Checks if a timer is running.
+ *  \param timer  Timer to check.
+ *  \return True (1) if the timer is running, false (0) otherwise.
+ */
+int swtimer_is_running(const SwTimer *timer);
+
+/*! \brief Returns the time since clock_init(), in microseconds.
+ *         Wraps around after about 71 minutes (see clock_now_us()).
+ */
+uint32_t swtimer_now_us(void);
+
+#endif // SWTIMER_H
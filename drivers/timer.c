@@ -1,25 +1,75 @@
 #include "platform.h"
 #include "timer.h"
 
+#define SYSTICK_MAX_RELOAD 0x1000000UL // LOAD is 24 bits wide
+
 uint32_t timer_period;
 
 static void (*timer_callback)(void) = 0;
+static uint32_t timer_divider = 1;            // SysTick interrupts per period
+static volatile uint32_t timer_countdown = 1; // interrupts left in this period
+static uint32_t timer_clock;                  // SystemCoreClock the timer was set up with
+static uint32_t timer_achieved;               // achieved period, in microseconds
+
+// Splits the period into divider equal SysTick reloads, in integers only.
+// Returns the reload, at least 2; divider is 1 whenever the period fits
+// SysTick.
+static uint32_t timer_compute(uint32_t period_us, uint32_t *divider) {
+	uint64_t cycles = ((uint64_t)SystemCoreClock * period_us + 500000) / 1000000;
 
-void timer_init(uint32_t timestamp) {
+	// SysTick_Config writes reload - 1 to LOAD, and LOAD = 0 stops the
+	// counter, so the shortest period is 2 cycles
+	if (cycles < 2) {
+		cycles = 2;
+	}
+	*divider = (uint32_t)((cycles + SYSTICK_MAX_RELOAD - 1) / SYSTICK_MAX_RELOAD);
+	return (uint32_t)((cycles + *divider / 2) / *divider);
+}
+
+uint32_t timer_init(uint32_t period_us) {
+	uint32_t primask = __get_PRIMASK();
+	uint32_t reload, divider;
 
 	// The timer should be able to tick anywhere from every
-	// microsecond to every second. In the unlikely event that
-	// the hardware is unable to divide down to a second, a
-	// software divider should be implemented.
+	// microsecond to every second (and beyond). Periods longer than
+	// SysTick's 24 bits allow are divided down in software.
+	reload = timer_compute(period_us, &divider);
+	timer_period = period_us;
+	timer_clock = SystemCoreClock;
+	timer_achieved = (uint32_t)(((uint64_t)reload * divider * 1000000 + SystemCoreClock / 2) / SystemCoreClock);
+
+	__disable_irq();
+	timer_divider = divider;
+	timer_countdown = divider;
+	__set_PRIMASK(primask);
 
-		uint32_t tick_us = (SystemCoreClock)/1e6;
-		tick_us = tick_us*timestamp;
-		SysTick_Config(tick_us);
-		NVIC_SetPriority(SysTick_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), 0, 2)); // Priority is set here
+	SysTick_Config(reload);
+	NVIC_SetPriority(SysTick_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), 0, 2)); // Priority is set here
+	return timer_achieved;
+}
 
+uint32_t timer_get_period(void) {
+	return timer_achieved;
+}
+
+uint32_t timer_update_clock(void) {
+	uint32_t enabled;
+
+	if (SystemCoreClock == timer_clock) {
+		return timer_achieved;
 	}
+	// Same period at the new clock, in the same running state
+	enabled = SysTick->CTRL & SysTick_CTRL_ENABLE_Msk;
+	timer_init(timer_period);
+	if (!enabled) {
+		timer_disable();
+	}
+	return timer_achieved;
+}
 
 void timer_enable(void) {
+	 timer_countdown = timer_divider;
+	 SysTick->VAL = 0; // start a full period
 	 SysTick->CTRL  = SysTick_CTRL_CLKSOURCE_Msk |
                    SysTick_CTRL_TICKINT_Msk   |
                    SysTick_CTRL_ENABLE_Msk;
@@ -44,7 +94,12 @@ void timer_set_callback(void (*callback)(void)) {
 
 void SysTick_Handler(void)
 {
-	timer_callback();
+	if (--timer_countdown == 0) {
+		timer_countdown = timer_divider;
+		if (timer_callback) {
+			timer_callback();
+		}
+	}
 }
 
 // *******************************ARM University Program Copyright � ARM Ltd 2016*************************************
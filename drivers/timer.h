@@ -7,12 +7,25 @@
 #define TIMER_H
 #include <stdint.h>
 
-/*! \brief Initialises the timer with a specified period.
- *  \param period  Period of the timer tick (in cpu \a cycles). 
+/*! \brief Initialises the timer with a specified period and starts it.
+ *  The period is converted to SysTick reloads with integer arithmetic
+ *  from the current SystemCoreClock. Periods beyond SysTick's 24-bit
+ *  reload (about 167 ms at 100 MHz) are split into several equal
+ *  reloads, with the callback run on the last one.
+ *  \param period_us  Period of the timer tick, in microseconds.
+ *  \return The achieved period, in microseconds (rounded).
  */
- 
-void timer_irq_handler(void); 
-void timer_init(uint32_t timestamp);
+uint32_t timer_init(uint32_t period_us);
+
+/*! \brief Returns the achieved period, in microseconds (rounded). */
+uint32_t timer_get_period(void);
+
+/*! \brief Re-applies the period after SystemCoreClock changed.
+ *  Call after switching clocks (and SystemCoreClockUpdate()). Leaves
+ *  the timer enabled or disabled as it was.
+ *  \return The achieved period, in microseconds (rounded).
+ */
+uint32_t timer_update_clock(void);
 
 /*! \brief Pass a callback to the API, which is executed during the
  *         interrupt handler.
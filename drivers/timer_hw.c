@@ -0,0 +1,520 @@
+#include "platform.h"
+#include "timer_hw.h"
+#include "gpio.h"
+#include "STM32F4xx_RCC.h"
+
+// Settings of one channel, before shifting them into place with
+// CCMR_SHIFT and CCER_SHIFT.
+#define CCMR_FIELD  0xFF
+#define CCMR_CCS_TI 0x01 // CCxS: capture from the channel's own input
+#define CCMR_OCPE   0x08 // compare value preloaded at the update event
+#define CCMR_OCM    0x70 // output compare mode
+#define CCMR_OCM_TOGGLE   0x30
+#define CCMR_OCM_INACTIVE 0x40 // forced
+#define CCMR_OCM_ACTIVE   0x50 // forced
+#define CCMR_OCM_PWM1     0x60
+#define CCER_FIELD  0xF
+#define CCER_CCE    0x1  // capture/compare enable
+#define CCER_CCP    0x2  // falling edge (or, with CCNP, both)
+#define CCER_CCNP   0x8
+
+#define CCMR_SHIFT(channel) (((channel) - 1) % 2 * 8)
+#define CCER_SHIFT(channel) (((channel) - 1) * 4)
+
+#define TIMER_HW_IRQ_FLAGS (TIM_SR_UIF | TIM_SR_CC1IF | TIM_SR_CC2IF | TIM_SR_CC3IF | TIM_SR_CC4IF)
+
+// Interrupt flags of a DMA stream, before shifting them into place
+// with dma_flag_shift.
+#define DMA_ALL_FLAGS 0x3D
+
+static const uint8_t dma_flag_shift[8] = { 0, 6, 16, 22, 0, 6, 16, 22 };
+
+#define TIMER_HW_DEFAULT_PRIORITY 3
+#define TIMER_HW_MAX_PRESCALER 0x10000 // PSC is 16 bits wide
+
+// DMA stream serving the capture/compare requests of one channel.
+typedef struct {
+	DMA_Stream_TypeDef *stream; // 0 if the channel has none
+	uint8_t stream_index;
+	uint8_t channel;
+} TimerHwDma;
+
+// Fixed wiring of a timer.
+typedef struct {
+	TIM_TypeDef *tim;
+	int apb2;           // clocked from APB2 rather than APB1
+	uint32_t rcc;       // RCC_APBxPeriph_TIMx
+	IRQn_Type irq;      // update interrupt (for all but TIM1, every interrupt)
+	IRQn_Type cc_irq;   // capture/compare interrupt
+	uint8_t channels;
+	uint8_t wide;       // 32-bit counter and auto-reload
+	uint8_t advanced;   // outputs gated by BDTR.MOE
+	DMA_TypeDef *dma;
+	uint32_t dma_rcc;   // RCC_AHB1Periph_DMAx
+	TimerHwDma channel_dma[4];
+} TimerHwInfo;
+
+struct TimerHw {
+	const TimerHwInfo *info;
+	uint32_t priority;
+	TimerHwUpdateCallback update_callback;
+	TimerHwChannelCallback channel_callback[4];
+	uint32_t dma_count[4];   // size of each channel's capture buffer
+	uint32_t *dma_buffer[4]; // each channel's capture buffer, 0 if none
+	uint32_t dma_marked[4];  // write position at the last counted wrap
+};
+
+// Streams that clash with the UART driver's (DMA1 Stream5/6 for USART2,
+// DMA2 Stream1/2/6/7 for USART1 and USART6) are only usable while that
+// USART doesn't use DMA. TIM9-TIM11 have no DMA requests.
+static const TimerHwInfo timer_hw_info[TIMER_HW_TIMERS] = {
+	{ // TIM1: DMA2 Stream1/2/6/4 ch6
+		TIM1, 1, RCC_APB2Periph_TIM1, TIM1_UP_TIM10_IRQn, TIM1_CC_IRQn, 4, 0, 1,
+		DMA2, RCC_AHB1Periph_DMA2,
+		{ { DMA2_Stream1, 1, 6 }, { DMA2_Stream2, 2, 6 }, { DMA2_Stream6, 6, 6 }, { DMA2_Stream4, 4, 6 } }
+	},
+	{ // TIM2: DMA1 Stream5/6/1/7 ch3
+		TIM2, 0, RCC_APB1Periph_TIM2, TIM2_IRQn, TIM2_IRQn, 4, 1, 0,
+		DMA1, RCC_AHB1Periph_DMA1,
+		{ { DMA1_Stream5, 5, 3 }, { DMA1_Stream6, 6, 3 }, { DMA1_Stream1, 1, 3 }, { DMA1_Stream7, 7, 3 } }
+	},
+	{ // TIM3: DMA1 Stream4/5/7/2 ch5
+		TIM3, 0, RCC_APB1Periph_TIM3, TIM3_IRQn, TIM3_IRQn, 4, 0, 0,
+		DMA1, RCC_AHB1Periph_DMA1,
+		{ { DMA1_Stream4, 4, 5 }, { DMA1_Stream5, 5, 5 }, { DMA1_Stream7, 7, 5 }, { DMA1_Stream2, 2, 5 } }
+	},
+	{ // TIM4: DMA1 Stream0/3/7 ch2, none for channel 4
+		TIM4, 0, RCC_APB1Periph_TIM4, TIM4_IRQn, TIM4_IRQn, 4, 0, 0,
+		DMA1, RCC_AHB1Periph_DMA1,
+		{ { DMA1_Stream0, 0, 2 }, { DMA1_Stream3, 3, 2 }, { DMA1_Stream7, 7, 2 }, { 0, 0, 0 } }
+	},
+	// TIM9-TIM11: no DMA
+	{ TIM9, 1, RCC_APB2Periph_TIM9, TIM1_BRK_TIM9_IRQn, TIM1_BRK_TIM9_IRQn, 2, 0, 0, 0, 0, { { 0, 0, 0 } } },
+	{ TIM10, 1, RCC_APB2Periph_TIM10, TIM1_UP_TIM10_IRQn, TIM1_UP_TIM10_IRQn, 1, 0, 0, 0, 0, { { 0, 0, 0 } } },
+	{ TIM11, 1, RCC_APB2Periph_TIM11, TIM1_TRG_COM_TIM11_IRQn, TIM1_TRG_COM_TIM11_IRQn, 1, 0, 0, 0, 0, { { 0, 0, 0 } } }
+};
+
+#define TIMER_HW_INITIALISER(n) { \
+	.info = &timer_hw_info[n], \
+	.priority = TIMER_HW_DEFAULT_PRIORITY }
+
+static TimerHw timers[TIMER_HW_TIMERS] = {
+	TIMER_HW_INITIALISER(TimerHwTim1),
+	TIMER_HW_INITIALISER(TimerHwTim2),
+	TIMER_HW_INITIALISER(TimerHwTim3),
+	TIMER_HW_INITIALISER(TimerHwTim4),
+	TIMER_HW_INITIALISER(TimerHwTim9),
+	TIMER_HW_INITIALISER(TimerHwTim10),
+	TIMER_HW_INITIALISER(TimerHwTim11)
+};
+
+TimerHw *timer_hw_get(TimerHwId id) {
+	return &timers[id];
+}
+
+// Timers run at twice PCLK whenever their APB is divided down
+static uint32_t timer_hw_clock(const TimerHwInfo *info) {
+	RCC_ClocksTypeDef clocks;
+	uint32_t pclk;
+
+	RCC_GetClocksFreq(&clocks);
+	pclk = info->apb2 ? clocks.PCLK2_Frequency : clocks.PCLK1_Frequency;
+	return pclk == clocks.HCLK_Frequency ? pclk : 2 * pclk;
+}
+
+// Splits a period of ticks clock ticks into PSC and ARR, using the
+// smallest prescaler whose reload fits. Returns false if none does.
+static int timer_hw_compute(const TimerHwInfo *info, uint32_t clock, uint64_t ticks, TimerHwReport *report) {
+	uint64_t max_reload = info->wide ? 0x100000000ULL : 0x10000;
+	uint64_t prescaler, reload, achieved;
+
+	prescaler = (ticks + max_reload - 1) / max_reload;
+	if (prescaler == 0) {
+		prescaler = 1;
+	}
+	if (prescaler > TIMER_HW_MAX_PRESCALER) {
+		return 0;
+	}
+	reload = (ticks + prescaler / 2) / prescaler;
+	if (reload < 2) {
+		return 0; // the counter doesn't run with ARR = 0
+	}
+
+	achieved = prescaler * reload;
+	report->clock = clock;
+	report->psc = (uint32_t)(prescaler - 1);
+	report->arr = (uint32_t)(reload - 1);
+	// Split to keep the product within 64 bits
+	report->achieved_ns = achieved / clock * 1000000000 + achieved % clock * 1000000000 / clock;
+	report->error_ppm = (int32_t)(((int64_t)report->achieved_ns - (int64_t)report->requested_ns) * 1000000 /
+	                              (int64_t)report->requested_ns);
+	return 1;
+}
+
+static void timer_hw_apply(TimerHw *timer, const TimerHwReport *report) {
+	TIM_TypeDef *tim = timer->info->tim;
+
+	if (timer->info->apb2) {
+		RCC_APB2PeriphClockCmd(timer->info->rcc, ENABLE);
+	} else {
+		RCC_APB1PeriphClockCmd(timer->info->rcc, ENABLE);
+	}
+
+	// URS keeps the update interrupt to counter overflows, so loading
+	// the new values below doesn't call back
+	tim->CR1 = TIM_CR1_URS | TIM_CR1_ARPE;
+	tim->PSC = report->psc;
+	tim->ARR = report->arr;
+	tim->CNT = 0;
+	tim->EGR = TIM_EGR_UG; // load PSC (and the preloaded ARR)
+	tim->SR = 0;
+}
+
+int timer_hw_init_us(TimerHw *timer, uint32_t period_us, TimerHwReport *report) {
+	uint32_t clock = timer_hw_clock(timer->info);
+	TimerHwReport local;
+
+	if (!report) {
+		report = &local;
+	}
+	report->requested_ns = (uint64_t)period_us * 1000;
+	if (period_us == 0 ||
+	    !timer_hw_compute(timer->info, clock, ((uint64_t)clock * period_us + 500000) / 1000000, report)) {
+		return 0;
+	}
+	timer_hw_apply(timer, report);
+	return 1;
+}
+
+int timer_hw_init_hz(TimerHw *timer, uint32_t frequency_hz, TimerHwReport *report) {
+	uint32_t clock = timer_hw_clock(timer->info);
+	TimerHwReport local;
+
+	if (!report) {
+		report = &local;
+	}
+	if (frequency_hz == 0) {
+		return 0;
+	}
+	report->requested_ns = (1000000000ULL + frequency_hz / 2) / frequency_hz;
+	if (!timer_hw_compute(timer->info, clock, ((uint64_t)clock + frequency_hz / 2) / frequency_hz, report)) {
+		return 0;
+	}
+	timer_hw_apply(timer, report);
+	return 1;
+}
+
+void timer_hw_start(TimerHw *timer) {
+	timer->info->tim->CR1 |= TIM_CR1_CEN;
+}
+
+void timer_hw_stop(TimerHw *timer) {
+	timer->info->tim->CR1 &= ~TIM_CR1_CEN;
+	timer->info->tim->SR = ~TIM_SR_UIF;
+}
+
+uint32_t timer_hw_counter(const TimerHw *timer) {
+	return timer->info->tim->CNT;
+}
+
+uint32_t timer_hw_tick_rate(const TimerHw *timer) {
+	uint32_t prescaler = timer->info->tim->PSC + 1;
+
+	return (timer_hw_clock(timer->info) + prescaler / 2) / prescaler;
+}
+
+uint32_t timer_hw_period_ticks(const TimerHw *timer) {
+	return timer->info->tim->ARR + 1;
+}
+
+void timer_hw_set_priority(TimerHw *timer, uint32_t priority) {
+	timer->priority = priority;
+	NVIC_SetPriority(timer->info->irq, priority);
+	NVIC_SetPriority(timer->info->cc_irq, priority);
+}
+
+static void timer_hw_enable_irq(TimerHw *timer) {
+	timer_hw_set_priority(timer, timer->priority);
+	NVIC_EnableIRQ(timer->info->irq);
+	NVIC_EnableIRQ(timer->info->cc_irq);
+}
+
+// Enables the update interrupt while there is a callback or a DMA
+// capture whose wraps are counted.
+static void timer_hw_update_irq(TimerHw *timer) {
+	TIM_TypeDef *tim = timer->info->tim;
+	int needed = timer->update_callback != 0;
+	uint32_t channel;
+
+	for (channel = 0; channel < 4; channel++) {
+		needed |= timer->dma_buffer[channel] != 0;
+	}
+	if (!needed) {
+		tim->DIER &= ~TIM_DIER_UIE;
+	} else if (!(tim->DIER & TIM_DIER_UIE)) {
+		tim->SR = ~TIM_SR_UIF;
+		tim->DIER |= TIM_DIER_UIE;
+		timer_hw_enable_irq(timer);
+	}
+}
+
+void timer_hw_set_update_callback(TimerHw *timer, TimerHwUpdateCallback callback) {
+	timer->update_callback = callback;
+	timer_hw_update_irq(timer);
+}
+
+static volatile uint32_t *timer_hw_ccmr(TIM_TypeDef *tim, uint32_t channel) {
+	return channel <= 2 ? &tim->CCMR1 : &tim->CCMR2;
+}
+
+static void dma_clear_flags(const TimerHwInfo *info, uint32_t stream_index, uint32_t flags) {
+	if (stream_index < 4) {
+		info->dma->LIFCR = flags << dma_flag_shift[stream_index];
+	} else {
+		info->dma->HIFCR = flags << dma_flag_shift[stream_index];
+	}
+}
+
+// Disables a DMA stream and waits until it has let go
+static void timer_hw_dma_disable(const TimerHwInfo *info, const TimerHwDma *dma) {
+	dma->stream->CR &= ~DMA_SxCR_EN;
+	while (dma->stream->CR & DMA_SxCR_EN) {
+	}
+	dma_clear_flags(info, dma->stream_index, DMA_ALL_FLAGS);
+}
+
+// Resets a channel and leaves its settings to the caller. Returns false
+// if the timer doesn't have it.
+static int timer_hw_channel_reset(TimerHw *timer, uint32_t channel) {
+	TIM_TypeDef *tim = timer->info->tim;
+	volatile uint32_t *ccmr;
+
+	if (channel < 1 || channel > timer->info->channels) {
+		return 0;
+	}
+	ccmr = timer_hw_ccmr(tim, channel);
+	if (tim->DIER & (TIM_DIER_CC1DE << (channel - 1))) {
+		tim->DIER &= ~(TIM_DIER_CC1DE << (channel - 1));
+		timer_hw_dma_disable(timer->info, &timer->info->channel_dma[channel - 1]);
+		timer->dma_buffer[channel - 1] = 0;
+		timer_hw_update_irq(timer);
+	}
+	tim->DIER &= ~(TIM_DIER_CC1IE << (channel - 1));
+	tim->CCER &= ~(CCER_FIELD << CCER_SHIFT(channel)); // CCxS is only writable while off
+	*ccmr &= ~(CCMR_FIELD << CCMR_SHIFT(channel));
+	tim->SR = ~((TIM_SR_CC1IF | TIM_SR_CC1OF) << (channel - 1));
+	timer->channel_callback[channel - 1] = 0;
+	return 1;
+}
+
+static void timer_hw_channel_enable(TimerHw *timer, uint32_t channel, uint32_t ccer, TimerHwChannelCallback callback) {
+	TIM_TypeDef *tim = timer->info->tim;
+
+	tim->CCER |= ccer << CCER_SHIFT(channel);
+	timer->channel_callback[channel - 1] = callback;
+	if (callback) {
+		tim->DIER |= TIM_DIER_CC1IE << (channel - 1);
+		timer_hw_enable_irq(timer);
+	}
+}
+
+int timer_hw_compare_init(TimerHw *timer, uint32_t channel, uint32_t ticks, TimerHwChannelCallback callback) {
+	if (!timer_hw_channel_reset(timer, channel)) {
+		return 0;
+	}
+	// Frozen output compare: the flag is set on a match, the pin is left alone
+	(&timer->info->tim->CCR1)[channel - 1] = ticks;
+	timer_hw_channel_enable(timer, channel, 0, callback);
+	return 1;
+}
+
+// Makes a reset channel capture from its own input. Returns its CCER
+// settings, to be applied once everything else is ready.
+static uint32_t timer_hw_capture_setup(TimerHw *timer, uint32_t channel, TimerHwEdge edge) {
+	uint32_t ccer = CCER_CCE;
+
+	if (edge == TimerHwFalling) {
+		ccer |= CCER_CCP;
+	} else if (edge == TimerHwBoth) {
+		ccer |= CCER_CCP | CCER_CCNP;
+	}
+	*timer_hw_ccmr(timer->info->tim, channel) |= CCMR_CCS_TI << CCMR_SHIFT(channel);
+	return ccer;
+}
+
+int timer_hw_capture_init(TimerHw *timer, uint32_t channel, TimerHwEdge edge, TimerHwChannelCallback callback) {
+	uint32_t ccer;
+
+	if (!timer_hw_channel_reset(timer, channel)) {
+		return 0;
+	}
+	ccer = timer_hw_capture_setup(timer, channel, edge);
+	timer_hw_channel_enable(timer, channel, ccer, callback);
+	return 1;
+}
+
+int timer_hw_capture_dma_start(TimerHw *timer, uint32_t channel, TimerHwEdge edge, uint32_t *buffer, uint32_t count) {
+	const TimerHwInfo *info = timer->info;
+	const TimerHwDma *dma;
+	uint32_t ccer;
+
+	// Validate before resetting, so a failed call leaves the channel alone
+	if (channel < 1 || channel > info->channels || !info->channel_dma[channel - 1].stream ||
+	    count == 0 || count > TIMER_HW_DMA_MAX_COUNT) {
+		return 0;
+	}
+	timer_hw_channel_reset(timer, channel);
+	dma = &info->channel_dma[channel - 1];
+	ccer = timer_hw_capture_setup(timer, channel, edge);
+
+	RCC_AHB1PeriphClockCmd(info->dma_rcc, ENABLE);
+	timer_hw_dma_disable(info, dma);
+	dma->stream->CR = ((uint32_t)dma->channel << DMA_SxCR_CHSEL_Pos) |
+	                  DMA_SxCR_MSIZE_1 | DMA_SxCR_PSIZE_1 | // 32-bit transfers
+	                  DMA_SxCR_MINC |                       // memory increment
+	                  DMA_SxCR_CIRC;                        // peripheral to memory, wrapping around
+	dma->stream->PAR = (uint32_t)&(&info->tim->CCR1)[channel - 1];
+	dma->stream->M0AR = (uint32_t)buffer;
+	dma->stream->NDTR = count;
+	dma->stream->CR |= DMA_SxCR_EN;
+	timer->dma_count[channel - 1] = count;
+	timer->dma_buffer[channel - 1] = buffer;
+	timer->dma_marked[channel - 1] = 0;
+	timer_hw_update_irq(timer); // counts the wraps
+
+	info->tim->DIER |= TIM_DIER_CC1DE << (channel - 1);
+	timer_hw_channel_enable(timer, channel, ccer, 0);
+	return 1;
+}
+
+uint32_t timer_hw_capture_dma_position(const TimerHw *timer, uint32_t channel) {
+	uint32_t count = timer->dma_count[channel - 1];
+	uint32_t position = count - timer->info->channel_dma[channel - 1].stream->NDTR;
+
+	return position == count ? 0 : position;
+}
+
+int timer_hw_output_init(TimerHw *timer, uint32_t channel, Pin pin, uint32_t af, uint32_t ticks) {
+	TIM_TypeDef *tim = timer->info->tim;
+
+	if (!timer_hw_channel_reset(timer, channel)) {
+		return 0;
+	}
+	(&tim->CCR1)[channel - 1] = ticks;
+	*timer_hw_ccmr(tim, channel) |= CCMR_OCM_INACTIVE << CCMR_SHIFT(channel);
+	timer_hw_channel_enable(timer, channel, CCER_CCE, 0);
+	if (timer->info->advanced) {
+		tim->BDTR |= TIM_BDTR_MOE;
+	}
+	gpio_set_alternate(pin, af); // only now, so the pin never glitches
+	return 1;
+}
+
+void timer_hw_output_set(TimerHw *timer, uint32_t channel, TimerHwOutput output) {
+	static const uint8_t modes[] = {
+		CCMR_OCM_INACTIVE, CCMR_OCM_ACTIVE, CCMR_OCM_TOGGLE, CCMR_OCM_PWM1 | CCMR_OCPE
+	};
+	volatile uint32_t *ccmr = timer_hw_ccmr(timer->info->tim, channel);
+	uint32_t primask = __get_PRIMASK();
+
+	// Read-modify-write of a register shared with another channel
+	__disable_irq();
+	*ccmr = (*ccmr & ~((CCMR_OCM | CCMR_OCPE) << CCMR_SHIFT(channel))) | (uint32_t)modes[output] << CCMR_SHIFT(channel);
+	__set_PRIMASK(primask);
+}
+
+void timer_hw_set_compare(TimerHw *timer, uint32_t channel, uint32_t ticks) {
+	(&timer->info->tim->CCR1)[channel - 1] = ticks;
+}
+
+void timer_hw_channel_disable(TimerHw *timer, uint32_t channel) {
+	timer_hw_channel_reset(timer, channel);
+}
+
+// Adds a counter wrap to the entry of the last edge each DMA capture
+// took before it. Edges captured between the wrap and the interrupt
+// (counter values up to now) came after it; an edge that early in the
+// previous period, after the previous interrupt and followed by no
+// other, can't be told apart and is taken for one of those. Periods
+// beyond 16 bits leave no room in the entries and go uncounted.
+static void timer_hw_count_wraps(TimerHw *timer, uint32_t now) {
+	uint32_t channel, count, position, written, slot;
+	uint32_t *buffer;
+
+	if (timer->info->tim->ARR >= TIMER_HW_WRAP_PERIOD_MAX) {
+		return;
+	}
+	for (channel = 1; channel <= timer->info->channels; channel++) {
+		buffer = timer->dma_buffer[channel - 1];
+		if (!buffer) {
+			continue;
+		}
+		count = timer->dma_count[channel - 1];
+		position = timer_hw_capture_dma_position(timer, channel);
+		// Only edges written since the previous wrap can be after this one
+		written = (position + count - timer->dma_marked[channel - 1]) % count;
+		slot = (position + count - 1) % count;
+		while (written && TIMER_HW_CAPTURE_TICKS(buffer[slot]) <= now) {
+			slot = (slot + count - 1) % count;
+			written--;
+		}
+		if (TIMER_HW_CAPTURE_WRAPS(buffer[slot]) != TIMER_HW_CAPTURE_MAX_WRAPS) {
+			buffer[slot] += TIMER_HW_WRAP_PERIOD_MAX;
+		}
+		timer->dma_marked[channel - 1] = position;
+	}
+}
+
+static void timer_hw_irq(TimerHw *timer) {
+	TIM_TypeDef *tim = timer->info->tim;
+	uint32_t now = tim->CNT; // as close to the wrap as it gets
+	uint32_t flags = tim->SR & tim->DIER & TIMER_HW_IRQ_FLAGS;
+	uint32_t channel, value;
+
+	if (flags & TIM_SR_UIF) {
+		tim->SR = ~TIM_SR_UIF;
+		timer_hw_count_wraps(timer, now);
+		if (timer->update_callback) {
+			timer->update_callback();
+		}
+	}
+	for (channel = 1; channel <= timer->info->channels; channel++) {
+		if (flags & (TIM_SR_CC1IF << (channel - 1))) {
+			// A capture lost to an overcapture is simply gone
+			tim->SR = ~((TIM_SR_CC1IF | TIM_SR_CC1OF) << (channel - 1));
+			value = (&tim->CCR1)[channel - 1];
+			if (timer->channel_callback[channel - 1]) {
+				timer->channel_callback[channel - 1](channel, value);
+			}
+		}
+	}
+}
+
+void TIM1_UP_TIM10_IRQHandler(void) {
+	timer_hw_irq(&timers[TimerHwTim1]);
+	timer_hw_irq(&timers[TimerHwTim10]);
+}
+
+void TIM1_CC_IRQHandler(void) {
+	timer_hw_irq(&timers[TimerHwTim1]);
+}
+
+void TIM1_BRK_TIM9_IRQHandler(void) {
+	timer_hw_irq(&timers[TimerHwTim9]);
+}
+
+void TIM1_TRG_COM_TIM11_IRQHandler(void) {
+	timer_hw_irq(&timers[TimerHwTim11]);
+}
+
+void TIM2_IRQHandler(void) {
+	timer_hw_irq(&timers[TimerHwTim2]);
+}
+
+void TIM3_IRQHandler(void) {
+	timer_hw_irq(&timers[TimerHwTim3]);
+}
+
+void TIM4_IRQHandler(void) {
+	timer_hw_irq(&timers[TimerHwTim4]);
+}
@@ -0,0 +1,227 @@
+/*!
+ * \file      timer_hw.h
+ * \brief     General purpose hardware timers (TIMx).
+ *
+ * Runs TIM1-TIM4 and TIM9-TIM11 with periods given in microseconds or
+ * hertz. The prescaler and auto-reload values are worked out with
+ * integer arithmetic from the current timer clock, picking the smallest
+ * prescaler (so the finest resolution) that fits the period.
+ *
+ * Each timer can call back on its update event (once a period) and on
+ * compare or capture events of its channels. Channels can also drive
+ * their pin in hardware (toggle, PWM or a held level), costing no CPU
+ * time at all once set up. TIM5 is not offered: it runs the system
+ * clock (clock.h).
+ *
+ * TIM1 and TIM10 share their update interrupt (and TIM1 its break and
+ * trigger interrupts with TIM9 and TIM11), so those pairs share their
+ * priority as well.
+ */
+#ifndef TIMER_HW_H
+#define TIMER_HW_H
+#include <stdint.h>
+#include "platform.h"
+
+/*! The timers the driver can operate. */
+typedef enum {
+	TimerHwTim1,  //!< TIM1, 16 bits, 4 channels, on APB2.
+	TimerHwTim2,  //!< TIM2, 32 bits, 4 channels, on APB1.
+	TimerHwTim3,  //!< TIM3, 16 bits, 4 channels, on APB1.
+	TimerHwTim4,  //!< TIM4, 16 bits, 4 channels, on APB1.
+	TimerHwTim9,  //!< TIM9, 16 bits, 2 channels, on APB2.
+	TimerHwTim10, //!< TIM10, 16 bits, 1 channel, on APB2.
+	TimerHwTim11, //!< TIM11, 16 bits, 1 channel, on APB2.
+	TIMER_HW_TIMERS //!< Amount of timers.
+} TimerHwId;
+
+/*! Handle of one timer. Obtained with timer_hw_get(). */
+typedef struct TimerHw TimerHw;
+
+/*! Largest capture buffer, in entries (NDTR is 16 bits wide). */
+#define TIMER_HW_DMA_MAX_COUNT 0xFFFF
+
+/*! Periods (ARR + 1) up to this many ticks have their wraps counted in
+ *  the DMA capture buffer entries.
+ */
+#define TIMER_HW_WRAP_PERIOD_MAX 0x10000
+
+/*! Counter value of a DMA capture buffer entry. */
+#define TIMER_HW_CAPTURE_TICKS(entry) ((entry) & 0xFFFF)
+
+/*! Counter wraps after the capture of a DMA capture buffer entry,
+ *  until the next capture (at most TIMER_HW_CAPTURE_MAX_WRAPS).
+ */
+#define TIMER_HW_CAPTURE_WRAPS(entry) ((entry) >> 16)
+
+/*! Wrap count at which an entry stops counting. */
+#define TIMER_HW_CAPTURE_MAX_WRAPS 0xFFFF
+
+/*! The period actually programmed into the timer. */
+typedef struct {
+	uint64_t requested_ns; //!< Requested period, in nanoseconds.
+	uint64_t achieved_ns;  //!< Period the programmed values produce, in nanoseconds.
+	int32_t error_ppm;     //!< (achieved - requested) / requested, in parts per million.
+	uint32_t clock;        //!< Timer clock the prescaler is applied to, in Hz.
+	uint32_t psc;          //!< Value written to PSC (clock division - 1).
+	uint32_t arr;          //!< Value written to ARR (ticks per period - 1).
+} TimerHwReport;
+
+/*! Edges an input capture channel reacts to. */
+typedef enum {
+	TimerHwRising,  //!< Rising edges.
+	TimerHwFalling, //!< Falling edges.
+	TimerHwBoth     //!< Both edges.
+} TimerHwEdge;
+
+/*! What a channel output does. Active is high. */
+typedef enum {
+	TimerHwOutputInactive, //!< Held inactive.
+	TimerHwOutputActive,   //!< Held active.
+	TimerHwOutputToggle,   //!< Toggles each time the counter reaches the compare value.
+	TimerHwOutputPwm       //!< Active from the start of each period until the compare value.
+} TimerHwOutput;
+
+/*! Called from the timer interrupt on an update event (the end of each
+ *  period).
+ */
+typedef void (*TimerHwUpdateCallback)(void);
+
+/*! Called from the timer interrupt on a compare match or a capture.
+ *  Receives the channel (1-4) and its CCR value, which for a capture is
+ *  the counter at the time of the edge.
+ */
+typedef void (*TimerHwChannelCallback)(uint32_t channel, uint32_t value);
+
+/*! \brief Returns the handle of a timer.
+ *  \param id  Timer to get.
+ *  \return Handle of the timer.
+ */
+TimerHw *timer_hw_get(TimerHwId id);
+
+/*! \brief Sets up a timer with a period in microseconds. The timer is
+ *         left stopped; callbacks and channels set up earlier are kept.
+ *  \param timer      Timer to set up.
+ *  \param period_us  Period, in microseconds.
+ *  \param report     Filled with the achieved period. May be null.
+ *  \return True (1) if the period is within the timer's range, false
+ *          (0) otherwise, in which case the timer is left untouched.
+ */
+int timer_hw_init_us(TimerHw *timer, uint32_t period_us, TimerHwReport *report);
+
+/*! \brief Sets up a timer with a frequency in hertz, like
+ *         timer_hw_init_us().
+ *  \param timer         Timer to set up.
+ *  \param frequency_hz  Update events per second.
+ *  \param report        Filled with the achieved period. May be null.
+ *  \return True (1) if the frequency is within the timer's range, false
+ *          (0) otherwise.
+ */
+int timer_hw_init_hz(TimerHw *timer, uint32_t frequency_hz, TimerHwReport *report);
+
+/*! \brief Starts (or resumes) counting. */
+void timer_hw_start(TimerHw *timer);
+
+/*! \brief Stops counting. The counter keeps its value and a pending
+ *         update is dropped.
+ */
+void timer_hw_stop(TimerHw *timer);
+
+/*! \brief Returns the counter value, in ticks. */
+uint32_t timer_hw_counter(const TimerHw *timer);
+
+/*! \brief Returns the counter ticks per second (rounded). */
+uint32_t timer_hw_tick_rate(const TimerHw *timer);
+
+/*! \brief Returns the period in ticks (ARR + 1). Compare values are
+ *         below this.
+ */
+uint32_t timer_hw_period_ticks(const TimerHw *timer);
+
+/*! \brief Sets the priority of the timer's interrupts (3 by default). */
+void timer_hw_set_priority(TimerHw *timer, uint32_t priority);
+
+/*! \brief Sets the function called on each update event.
+ *  \param timer     Timer.
+ *  \param callback  Function to call, or 0 to disable the interrupt.
+ */
+void timer_hw_set_update_callback(TimerHw *timer, TimerHwUpdateCallback callback);
+
+/*! \brief Makes a channel a compare channel, calling back whenever the
+ *         counter reaches a value. The pin is not driven.
+ *  \param timer     Timer.
+ *  \param channel   Channel, 1 up to the amount the timer has.
+ *  \param ticks     Counter value to match, below timer_hw_period_ticks().
+ *  \param callback  Function to call, or 0 for none.
+ *  \return True (1) on success, false (0) if the channel doesn't exist.
+ */
+int timer_hw_compare_init(TimerHw *timer, uint32_t channel, uint32_t ticks, TimerHwChannelCallback callback);
+
+/*! \brief Makes a channel an input capture channel, latching the
+ *         counter on each selected edge of its pin. The pin must be
+ *         switched to the timer's alternate function by the caller.
+ *  \param timer     Timer.
+ *  \param channel   Channel, 1 up to the amount the timer has.
+ *  \param edge      Edges to capture.
+ *  \param callback  Function to call for each capture, or 0 for none.
+ *  \return True (1) on success, false (0) if the channel doesn't exist.
+ */
+int timer_hw_capture_init(TimerHw *timer, uint32_t channel, TimerHwEdge edge, TimerHwChannelCallback callback);
+
+/*! \brief Makes a channel an input capture channel whose captures the
+ *         DMA writes into a circular buffer, with no interrupt per edge.
+ *         While the period is at most TIMER_HW_WRAP_PERIOD_MAX ticks,
+ *         the update interrupt counts the counter wraps following each
+ *         capture into the upper half of its entry (read them with
+ *         TIMER_HW_CAPTURE_TICKS() and TIMER_HW_CAPTURE_WRAPS()), so
+ *         intervals longer than the period can be told apart. The pin
+ *         must be switched to the timer's alternate function by the
+ *         caller. Stop it with timer_hw_channel_disable().
+ *  \param timer    Timer, one of TIM1-TIM4.
+ *  \param channel  Channel with a DMA request (not TIM4 channel 4).
+ *  \param edge     Edges to capture.
+ *  \param buffer   Receives the counter at each edge, wrapping around.
+ *  \param count    Entries in buffer, 1 up to TIMER_HW_DMA_MAX_COUNT.
+ *  \return True (1) on success, false (0) if the channel has no DMA or
+ *          count is out of range, in which case the channel is left
+ *          untouched.
+ */
+int timer_hw_capture_dma_start(TimerHw *timer, uint32_t channel, TimerHwEdge edge, uint32_t *buffer, uint32_t count);
+
+/*! \brief Returns the index in the buffer the next capture will be
+ *         written to.
+ */
+uint32_t timer_hw_capture_dma_position(const TimerHw *timer, uint32_t channel);
+
+/*! \brief Makes a channel drive its pin, starting out held inactive.
+ *         Switches the pin to the timer's alternate function.
+ *  \param timer    Timer.
+ *  \param channel  Channel, 1 up to the amount the timer has.
+ *  \param pin      Pin of the channel.
+ *  \param af       Alternate function connecting pin to the channel.
+ *  \param ticks    Compare value: where in the period a toggle happens,
+ *                  or the PWM duty. Below timer_hw_period_ticks().
+ *  \return True (1) on success, false (0) if the channel doesn't exist.
+ */
+int timer_hw_output_init(TimerHw *timer, uint32_t channel, Pin pin, uint32_t af, uint32_t ticks);
+
+/*! \brief Changes what an output channel does. Takes effect at once;
+ *         a held level is kept by a toggle output until its next
+ *         compare match.
+ *  \param timer    Timer.
+ *  \param channel  Output channel set up with timer_hw_output_init().
+ *  \param output   New behaviour.
+ */
+void timer_hw_output_set(TimerHw *timer, uint32_t channel, TimerHwOutput output);
+
+/*! \brief Changes the compare value of a channel. For PWM it takes
+ *         effect at the start of the next period.
+ *  \param timer    Timer.
+ *  \param channel  Compare or output channel.
+ *  \param ticks    New compare value, below timer_hw_period_ticks().
+ */
+void timer_hw_set_compare(TimerHw *timer, uint32_t channel, uint32_t ticks);
+
+/*! \brief Turns a channel off and drops its callback. */
+void timer_hw_channel_disable(TimerHw *timer, uint32_t channel);
+
+#endif // TIMER_HW_H
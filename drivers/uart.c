@@ -3,98 +3,955 @@
 #include "STM32F4xx_RCC.h"
 #include "STM32F4xx_USART.h"
 #include "STM32F4xx_GPIO.h"
+#include "queue.h"
+#include "format.h"
+#include <string.h>
 
-static void (*UART_callback)(uint8_t);
+#define USART_SR_ERRORS (USART_SR_ORE | USART_SR_FE | USART_SR_NE | USART_SR_PE)
+
+#define DMA_MAX_TRANSFER 0xFFFF // NDTR is 16 bits wide
+
+// Interrupt flags of a DMA stream, before shifting them into place
+// with dma_flag_shift.
+#define DMA_FEIF  0x01
+#define DMA_DMEIF 0x04
+#define DMA_TEIF  0x08
+#define DMA_HTIF  0x10
+#define DMA_TCIF  0x20
+#define DMA_ALL_FLAGS (DMA_FEIF | DMA_DMEIF | DMA_TEIF | DMA_HTIF | DMA_TCIF)
+
+static const uint8_t dma_flag_shift[8] = { 0, 6, 16, 22, 0, 6, 16, 22 };
+
+// Fixed wiring of a USART: clocks, pins and DMA streams.
+typedef struct {
+	USART_TypeDef *usart;
+	IRQn_Type irq;
+	int apb2;                   // clocked from PCLK2 rather than PCLK1
+	uint32_t rcc;               // RCC_APBxPeriph_USARTx
+	GPIO_TypeDef *gpio;
+	uint32_t gpio_rcc;          // RCC_AHB1Periph_GPIOx
+	uint16_t pins;              // GPIO_Pin_x of TX and RX
+	uint8_t tx_source;          // GPIO_PinSourcex of TX
+	uint8_t rx_source;          // GPIO_PinSourcex of RX
+	uint8_t af;                 // GPIO_AF_USARTx
+	uint16_t cts_pin;           // GPIO_Pin_x of CTS, on the same port; 0 if not routed
+	uint16_t rts_pin;           // GPIO_Pin_x of RTS
+	uint8_t cts_source;         // GPIO_PinSourcex of CTS
+	DMA_TypeDef *dma;
+	uint32_t dma_rcc;           // RCC_AHB1Periph_DMAx
+	DMA_Stream_TypeDef *tx_stream;
+	uint8_t tx_stream_index;
+	uint8_t tx_channel;
+	IRQn_Type tx_dma_irq;
+	DMA_Stream_TypeDef *rx_stream;
+	uint8_t rx_stream_index;
+	uint8_t rx_channel;
+	IRQn_Type rx_dma_irq;
+} UartHw;
+
+// A buffer submitted for DMA transmission.
+typedef struct {
+	const uint8_t *data;    // next byte to transfer
+	uint32_t length;        // bytes left to transfer
+	const uint8_t *start;   // buffer as submitted, handed to the callback
+	uint32_t size;
+	UartDmaCallback done;
+	uint8_t last;           // last segment of its message
+} UartDmaRequest;
+
+struct UartPort {
+	const UartHw *hw;
+	void (*rx_callback)(uint8_t c);
+	void (*error_callback)(uint32_t errors);
+	volatile UartStats stats;
+	UartBaudReport baud_report;
+
+	// Bytes waiting to be transmitted, drained by the TXE interrupt.
+	Queue tx_queue;
+	UartTxPolicy tx_policy;
+
+	// Bytes received while no receive callback is set.
+	Queue rx_queue;
+
+	// RTS/CTS flow control: RTS is driven by hand from the fill level
+	// of flow_queue, CTS is left to the hardware.
+	int flow_control;
+	Queue *flow_queue;
+	uint32_t flow_high;
+	uint32_t flow_low;
+	int throttled;
+
+	// Submitted DMA buffers, sent back to back. Indices are free-running
+	// and only touched with interrupts masked or from the (equal
+	// priority) USART and DMA interrupts of the port.
+	UartDmaRequest dma_requests[UART_DMA_QUEUE_LEN];
+	uint32_t dma_head;
+	uint32_t dma_tail;
+	uint32_t dma_active; // bytes of the current transfer, 0 when idle
+
+	// Circular receive buffer filled by DMA, and the position up to
+	// which its contents have been delivered.
+	uint8_t *rx_dma_buffer;
+	uint32_t rx_dma_size;
+	uint32_t rx_dma_read;
+	UartRxChunkCallback rx_dma_callback;
+};
+
+static const UartHw uart_hw[UART_PORTS] = {
+	{ // USART1: PA9 TX, PA10 RX, PA11 CTS, PA12 RTS; DMA2 Stream7 ch4 TX, Stream2 ch4 RX
+		USART1, USART1_IRQn, 1, RCC_APB2Periph_USART1,
+		GPIOA, RCC_AHB1Periph_GPIOA, GPIO_Pin_9 | GPIO_Pin_10, GPIO_PinSource9, GPIO_PinSource10, GPIO_AF_USART1,
+		GPIO_Pin_11, GPIO_Pin_12, GPIO_PinSource11,
+		DMA2, RCC_AHB1Periph_DMA2,
+		DMA2_Stream7, 7, 4, DMA2_Stream7_IRQn,
+		DMA2_Stream2, 2, 4, DMA2_Stream2_IRQn
+	},
+	{ // USART2: PA2 TX, PA3 RX, PA0 CTS, PA1 RTS; DMA1 Stream6 ch4 TX, Stream5 ch4 RX
+		USART2, USART2_IRQn, 0, RCC_APB1Periph_USART2,
+		GPIOA, RCC_AHB1Periph_GPIOA, GPIO_Pin_2 | GPIO_Pin_3, GPIO_PinSource2, GPIO_PinSource3, GPIO_AF_USART2,
+		GPIO_Pin_0, GPIO_Pin_1, GPIO_PinSource0,
+		DMA1, RCC_AHB1Periph_DMA1,
+		DMA1_Stream6, 6, 4, DMA1_Stream6_IRQn,
+		DMA1_Stream5, 5, 4, DMA1_Stream5_IRQn
+	},
+	{ // USART6: PC6 TX, PC7 RX (CTS/RTS not available on the STM32F411); DMA2 Stream6 ch5 TX, Stream1 ch5 RX
+		USART6, USART6_IRQn, 1, RCC_APB2Periph_USART6,
+		GPIOC, RCC_AHB1Periph_GPIOC, GPIO_Pin_6 | GPIO_Pin_7, GPIO_PinSource6, GPIO_PinSource7, GPIO_AF_USART6,
+		0, 0, 0,
+		DMA2, RCC_AHB1Periph_DMA2,
+		DMA2_Stream6, 6, 5, DMA2_Stream6_IRQn,
+		DMA2_Stream1, 1, 5, DMA2_Stream1_IRQn
+	}
+};
+
+static uint8_t tx_storage[UART_PORTS][QUEUE_CHECKED_SIZE(UART_TX_BUFFER_SIZE)];
+static uint8_t rx_storage[UART_PORTS][QUEUE_CHECKED_SIZE(UART_RX_BUFFER_SIZE)];
+
+#define UART_PORT_INITIALISER(n) { \
+	.hw = &uart_hw[n], \
+	.tx_queue = QUEUE_INITIALISER(tx_storage[n], UART_TX_BUFFER_SIZE), \
+	.tx_policy = UartTxBlock, \
+	.rx_queue = QUEUE_INITIALISER(rx_storage[n], UART_RX_BUFFER_SIZE) }
+
+static UartPort ports[UART_PORTS] = {
+	UART_PORT_INITIALISER(UartUsart1),
+	UART_PORT_INITIALISER(UartUsart2),
+	UART_PORT_INITIALISER(UartUsart6)
+};
+
+#define CONSOLE (&ports[UART_CONSOLE])
+
+static uint32_t dma_flags(const UartPort *port, uint32_t stream_index) {
+	DMA_TypeDef *dma = port->hw->dma;
+	uint32_t isr = stream_index < 4 ? dma->LISR : dma->HISR;
+
+	return (isr >> dma_flag_shift[stream_index]) & DMA_ALL_FLAGS;
+}
+
+static void dma_clear_flags(const UartPort *port, uint32_t stream_index, uint32_t flags) {
+	DMA_TypeDef *dma = port->hw->dma;
+
+	if (stream_index < 4) {
+		dma->LIFCR = flags << dma_flag_shift[stream_index];
+	} else {
+		dma->HIFCR = flags << dma_flag_shift[stream_index];
+	}
+}
+
+UartPort *uart_get(UartId id) {
+	return &ports[id];
+}
+
+// Works out BRR for the requested baud rate using integers only.
+// In both oversampling modes BRR encodes divider = pclk / baud (16x: as
+// is, 8x: with the 3 fraction bits kept in place), so the divider is
+// rounded once and the achieved rate follows from it.
+static void uart_compute_baud(uint32_t pclk, const UartConfig *config, UartBaudReport *report) {
+	uint32_t min_divider = config->oversampling == UartOversample8 ? 8 : 16;
+	// The 12-bit mantissa caps the divider; in 8x mode BRR holds only
+	// 3 fraction bits, so one bit less of it is left
+	uint32_t max_divider = config->oversampling == UartOversample8 ? 0x7FFF : 0xFFFF;
+	uint32_t divider = (pclk + config->baud / 2) / config->baud;
+	int64_t difference;
+
+	if (divider < min_divider) {
+		divider = min_divider; // as fast as the peripheral goes
+	}
+	if (divider > max_divider) {
+		divider = max_divider; // as slow as the peripheral goes
+	}
+	report->requested = config->baud;
+	report->pclk = pclk;
+	report->achieved = (pclk + divider / 2) / divider;
+	if (config->oversampling == UartOversample8) {
+		report->brr = ((divider >> 3) << 4) | (divider & 0x7);
+	} else {
+		report->brr = divider;
+	}
+	difference = (int64_t)report->achieved - config->baud;
+	report->error_ppm = (int32_t)(difference * 1000000 / config->baud);
+}
 
 void uart_init(uint32_t baud) {
+	UartConfig config;
+	RCC_ClocksTypeDef clocks;
+	uint32_t pclk;
+
+	// Pick the settings for the rate: 8x oversampling only when 16x
+	// can't reach it, faster pins only above the classic rates.
+	RCC_GetClocksFreq(&clocks);
+	pclk = CONSOLE->hw->apb2 ? clocks.PCLK2_Frequency : clocks.PCLK1_Frequency;
+	config.baud = baud;
+	config.oversampling = baud > pclk / 16 ? UartOversample8 : UartOversample16;
+	config.pin_speed = baud > 230400 ? UartPinSpeedMedium : UartPinSpeedLow;
+	config.flow_control = UartFlowNone;
+	uart_port_init(CONSOLE, &config, 0);
+}
+
+int uart_init_config(const UartConfig *config, UartBaudReport *report) {
+	return uart_port_init(CONSOLE, config, report);
+}
+
+int uart_port_init(UartPort *port, const UartConfig *config, UartBaudReport *report) {
+	const UartHw *hw = port->hw;
 	GPIO_InitTypeDef GPIO_InitStructure;
 	USART_InitTypeDef USART_InitStructure;
-	
+	RCC_ClocksTypeDef clocks;
+	int32_t error;
+	int flow_control = config->flow_control == UartFlowRtsCts && hw->cts_pin;
+
 	/* --------------------------- System Clocks Configuration -----------------*/
-  /* USART2 clock enable */
-  RCC_APB1PeriphClockCmd(RCC_APB1Periph_USART2, ENABLE);
-  /* GPIOA clock enable */
-  RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_GPIOA, ENABLE);
-	
+  /* USARTx clock enable */
+  if (hw->apb2) {
+    RCC_APB2PeriphClockCmd(hw->rcc, ENABLE);
+  } else {
+    RCC_APB1PeriphClockCmd(hw->rcc, ENABLE);
+  }
+  /* GPIOx clock enable */
+  RCC_AHB1PeriphClockCmd(hw->gpio_rcc, ENABLE);
+
   /*-------------------------- GPIO Configuration ----------------------------*/
-  GPIO_InitStructure.GPIO_Pin = GPIO_Pin_2 | GPIO_Pin_3; // PA.2 USART2_TX, PA.3 USART2_RX
+  GPIO_InitStructure.GPIO_Pin = hw->pins; // USARTx_TX, USARTx_RX
   GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF;
   GPIO_InitStructure.GPIO_OType = GPIO_OType_PP;
   GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
-  GPIO_InitStructure.GPIO_Speed = GPIO_Speed_2MHz;
-  GPIO_Init(GPIOA, &GPIO_InitStructure);
+  GPIO_InitStructure.GPIO_Speed = (GPIOSpeed_TypeDef)config->pin_speed;
+  GPIO_Init(hw->gpio, &GPIO_InitStructure);
   /* Connect USART pins to AF */
-  GPIO_PinAFConfig(GPIOA, GPIO_PinSource2, GPIO_AF_USART2);
-  GPIO_PinAFConfig(GPIOA, GPIO_PinSource3, GPIO_AF_USART2);
-	
+  GPIO_PinAFConfig(hw->gpio, hw->tx_source, hw->af);
+  GPIO_PinAFConfig(hw->gpio, hw->rx_source, hw->af);
+
+	if (flow_control) {
+		// CTS is an input, pulled to "clear to send" so that an
+		// unconnected pin doesn't stall the transmitter
+		GPIO_InitStructure.GPIO_Pin = hw->cts_pin;
+		GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_DOWN;
+		GPIO_Init(hw->gpio, &GPIO_InitStructure);
+		GPIO_PinAFConfig(hw->gpio, hw->cts_source, hw->af);
+		// RTS is a plain output: the peripheral's own RTS only reflects
+		// the data register, the watermarks need it under software control
+		GPIO_ResetBits(hw->gpio, hw->rts_pin); // ready to receive
+		GPIO_InitStructure.GPIO_Pin = hw->rts_pin;
+		GPIO_InitStructure.GPIO_Mode = GPIO_Mode_OUT;
+		GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
+		GPIO_Init(hw->gpio, &GPIO_InitStructure);
+	}
+	port->flow_control = flow_control;
+	port->throttled = 0;
+	if (!port->flow_queue) {
+		uart_port_set_flow_queue(port, 0);
+	}
+
   /* USARTx configuration ------------------------------------------------------*/
   /* USARTx configured as follow:
-        - BaudRate = 115200 baud
+        - BaudRate = config->baud, 16x or 8x oversampling
         - Word Length = 8 Bits
         - One Stop Bit
         - No parity
-        - Hardware flow control disabled (RTS and CTS signals)
+        - Hardware flow control on CTS if requested (RTS is driven by software)
         - Receive and transmit enabled
   */
-  USART_InitStructure.USART_BaudRate = baud;
+  USART_InitStructure.USART_BaudRate = config->baud;
   USART_InitStructure.USART_WordLength = USART_WordLength_8b;
   USART_InitStructure.USART_StopBits = USART_StopBits_1;
   USART_InitStructure.USART_Parity = USART_Parity_No;
-  USART_InitStructure.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
+  USART_InitStructure.USART_HardwareFlowControl = flow_control ? USART_HardwareFlowControl_CTS : USART_HardwareFlowControl_None;
   USART_InitStructure.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;
-  USART_Init(USART2, &USART_InitStructure);
+  if (config->oversampling == UartOversample8) {
+    hw->usart->CR1 |= USART_CR1_OVER8;
+  } else {
+    hw->usart->CR1 &= ~USART_CR1_OVER8;
+  }
+  USART_Init(hw->usart, &USART_InitStructure);
+
+	// Replace the library's BRR (computed through floating point) with
+	// the integer one, and remember what it achieves.
+	RCC_GetClocksFreq(&clocks);
+	uart_compute_baud(hw->apb2 ? clocks.PCLK2_Frequency : clocks.PCLK1_Frequency, config, &port->baud_report);
+	hw->usart->BRR = port->baud_report.brr;
+	if (report) {
+		*report = port->baud_report;
+	}
+
+	// Received bytes are buffered in rx_queue until a callback is set.
+	// Receive errors are reported through the interrupt too: parity
+	// errors always, overrun/framing/noise errors while receiving
+	// through DMA (otherwise they arrive together with RXNE).
+	hw->usart->CR1 |= USART_CR1_RXNEIE | USART_CR1_PEIE;
+	hw->usart->CR3 |= USART_CR3_EIE;
+
+	// The interrupt serves both reception and transmission.
+	NVIC_SetPriority(hw->irq,1); // We set this in order for the button press to have higher priority
+	NVIC_ClearPendingIRQ(hw->irq);
+	NVIC_EnableIRQ(hw->irq);
+
+	/* DMA transmit stream configuration ------------------------------------------*/
+	RCC_AHB1PeriphClockCmd(hw->dma_rcc, ENABLE);
+	hw->tx_stream->CR = 0;
+	hw->tx_stream->CR = ((uint32_t)hw->tx_channel << DMA_SxCR_CHSEL_Pos) |
+	                    DMA_SxCR_MINC |               // memory increment, 8-bit transfers
+	                    DMA_SxCR_DIR_0 |              // memory to peripheral
+	                    DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+	hw->tx_stream->PAR = (uint32_t)&hw->usart->DR;
+	hw->usart->CR3 |= USART_CR3_DMAT;
+	NVIC_SetPriority(hw->tx_dma_irq, 1); // same as the USART, so the two never pre-empt each other
+	NVIC_ClearPendingIRQ(hw->tx_dma_irq);
+	NVIC_EnableIRQ(hw->tx_dma_irq);
+
+	error = port->baud_report.error_ppm < 0 ? -port->baud_report.error_ppm : port->baud_report.error_ppm;
+	return error <= UART_BAUD_TOLERANCE_PPM && flow_control == (config->flow_control == UartFlowRtsCts);
+}
+
+void uart_get_baud_report(UartBaudReport *report) {
+	uart_port_get_baud_report(CONSOLE, report);
+}
+
+void uart_port_get_baud_report(UartPort *port, UartBaudReport *report) {
+	*report = port->baud_report;
 }
 
 void uart_enable(void) {
-	USART_Cmd(USART2, ENABLE);
+	uart_port_enable(CONSOLE);
+}
+
+void uart_port_enable(UartPort *port) {
+	USART_Cmd(port->hw->usart, ENABLE);
+}
+
+// Works out the watermarks of the watched buffer, leaving room above
+// the high one for a whole receive DMA buffer. Called with interrupts
+// masked.
+static void uart_flow_limits(UartPort *port) {
+	uint32_t size = port->flow_queue->size;
+	uint32_t held = port->rx_dma_buffer ? port->rx_dma_size : 0;
+
+	port->flow_high = UART_FLOW_HIGH(size, held);
+	port->flow_low = UART_FLOW_LOW(size);
+	if (port->flow_low >= port->flow_high) {
+		port->flow_low = port->flow_high - 1;
+	}
+}
+
+void uart_port_set_flow_queue(UartPort *port, Queue *queue) {
+	uint32_t primask = __get_PRIMASK();
+
+	if (!queue) {
+		queue = &port->rx_queue;
+	}
+	__disable_irq();
+	port->flow_queue = queue;
+	uart_flow_limits(port);
+	__set_PRIMASK(primask);
+	uart_port_update_flow(port);
+}
+
+void uart_port_update_flow(UartPort *port) {
+	uint32_t primask;
+	uint32_t count;
+
+	if (!port->flow_control) {
+		return;
+	}
+	// Called by the receive interrupt and by the consumer, so the
+	// decision and the pin change go together
+	primask = __get_PRIMASK();
+	__disable_irq();
+	count = queue_count(port->flow_queue);
+	if (!port->throttled && count >= port->flow_high) {
+		GPIO_SetBits(port->hw->gpio, port->hw->rts_pin); // stop sending
+		port->throttled = 1;
+		port->stats.throttled++;
+	} else if (port->throttled && count <= port->flow_low) {
+		GPIO_ResetBits(port->hw->gpio, port->hw->rts_pin);
+		port->throttled = 0;
+	}
+	__set_PRIMASK(primask);
 }
 
 void uart_print(char *string) {
-	while(*string) {
-    uart_tx(*string++);
-  }
+	uart_port_write(CONSOLE, (const uint8_t *)string, strlen(string));
+}
+
+void uart_port_print(UartPort *port, const char *string) {
+	uart_port_write(port, (const uint8_t *)string, strlen(string));
+}
+
+// Formats the whole message first, so a single write queues it and
+// output from other contexts can't land in the middle of it
+static uint32_t uart_port_printf_v(UartPort *port, const char *format, va_list args) {
+	char message[UART_PRINTF_MAX];
+	uint32_t length = format_string_v(message, sizeof(message), format, args);
+
+	uart_port_write(port, (const uint8_t *)message, length < sizeof(message) ? length : sizeof(message) - 1);
+	return length;
+}
+
+uint32_t uart_printf(const char *format, ...) {
+	uint32_t written;
+	va_list args;
+	
+	va_start(args, format);
+	written = uart_port_printf_v(CONSOLE, format, args);
+	va_end(args);
+	return written;
+}
+
+uint32_t uart_port_printf(UartPort *port, const char *format, ...) {
+	uint32_t written;
+	va_list args;
+	
+	va_start(args, format);
+	written = uart_port_printf_v(port, format, args);
+	va_end(args);
+	return written;
+}
+
+void uart_set_tx_policy(UartTxPolicy policy) {
+	uart_port_set_tx_policy(CONSOLE, policy);
+}
+
+void uart_port_set_tx_policy(UartPort *port, UartTxPolicy policy) {
+	port->tx_policy = policy;
+}
+
+// Starts the oldest submitted DMA buffer, if the stream is idle.
+// Called with interrupts masked or from the USART/DMA interrupts.
+static void uart_dma_start(UartPort *port) {
+	const UartHw *hw = port->hw;
+	UartDmaRequest *request;
+
+	if (port->dma_active || port->dma_head == port->dma_tail) {
+		return;
+	}
+	request = &port->dma_requests[port->dma_head % UART_DMA_QUEUE_LEN];
+	port->dma_active = request->length < DMA_MAX_TRANSFER ? request->length : DMA_MAX_TRANSFER;
+	dma_clear_flags(port, hw->tx_stream_index, DMA_ALL_FLAGS);
+	hw->tx_stream->M0AR = (uint32_t)request->data;
+	hw->tx_stream->NDTR = port->dma_active;
+	hw->tx_stream->CR |= DMA_SxCR_EN;
+}
+
+// Retires the finished DMA transfer, then hands the data register to
+// whichever transmit path has work: the queue first, so console output
+// isn't held up by long DMA chains, then the next DMA buffer.
+static void uart_dma_done(UartPort *port) {
+	UartDmaRequest *request = &port->dma_requests[port->dma_head % UART_DMA_QUEUE_LEN];
+	int error = dma_flags(port, port->hw->tx_stream_index) & DMA_TEIF;
+	// A transfer error stops the stream with NDTR bytes still unsent
+	uint32_t sent = port->dma_active - port->hw->tx_stream->NDTR;
+
+	dma_clear_flags(port, port->hw->tx_stream_index, DMA_ALL_FLAGS);
+	request->data += sent;
+	request->length -= sent;
+	port->stats.tx_bytes += sent;
+	port->dma_active = 0;
+
+	if (error) {
+		// The failed access would fail again: give up on the rest of
+		// the message
+		port->stats.tx_errors++;
+		while (1) {
+			request = &port->dma_requests[port->dma_head % UART_DMA_QUEUE_LEN];
+			port->dma_head++;
+			if (request->last) {
+				break;
+			}
+		}
+		if (request->done) {
+			request->done(request->start, request->size, 0);
+		}
+	} else if (request->length == 0) {
+		port->dma_head++;
+		if (request->done) {
+			request->done(request->start, request->size, 1);
+		}
+	}
+	if (port->dma_active) {
+		// the callback submitted a buffer that is already on its way
+		return;
+	}
+	if (!queue_is_empty(&port->tx_queue)) {
+		SET_BIT(port->hw->usart->CR1, USART_CR1_TXEIE);
+	} else {
+		uart_dma_start(port);
+	}
+}
+
+// Stands in for the transmit interrupts while interrupts are masked:
+// moves one byte to the data register if it is free, or retires a
+// finished DMA transfer.
+static void uart_tx_pump(UartPort *port) {
+	USART_TypeDef *usart = port->hw->usart;
+	uint8_t c;
+
+	if (port->dma_active) {
+		if (dma_flags(port, port->hw->tx_stream_index) & (DMA_TCIF | DMA_TEIF)) {
+			uart_dma_done(port);
+		}
+	} else if (READ_BIT(usart->SR, USART_SR_TXE) && queue_dequeue(&port->tx_queue, &c)) {
+		usart->DR = c;
+		port->stats.tx_bytes++;
+	} else if (queue_is_empty(&port->tx_queue)) {
+		uart_dma_start(port);
+	}
+}
+
+// The USART and DMA interrupts take bytes out of tx_queue without
+// masking interrupts, so only the sole consumer may pump by hand: the
+// caller must not have pre-empted either of them. Finding one active
+// while running anywhere else means exactly that.
+static int uart_tx_can_pump(UartPort *port) {
+	uint32_t current = __get_IPSR(); // exception number, 0 in thread mode
+
+	return (!NVIC_GetActive(port->hw->irq) || current == (uint32_t)port->hw->irq + 16) &&
+	       (!NVIC_GetActive(port->hw->tx_dma_irq) || current == (uint32_t)port->hw->tx_dma_irq + 16);
+}
+
+uint32_t uart_write(const uint8_t *data, uint32_t length) {
+	return uart_port_write(CONSOLE, data, length);
+}
+
+uint32_t uart_port_write(UartPort *port, const uint8_t *data, uint32_t length) {
+	Queue *tx_queue = &port->tx_queue;
+	uint32_t primask = __get_PRIMASK();
+	uint32_t written = 0;
+	uint32_t space;
+
+	// Several contexts (main loop and ISRs) may print, so the copy into
+	// the transmit queue is done with interrupts masked.
+	__disable_irq();
+	space = tx_queue->size - queue_count(tx_queue);
+
+	// A caller that pre-empted the transmit interrupt can't wait for it
+	// to make room: it gets what fits.
+	if (length <= space || port->tx_policy == UartTxTruncate ||
+	    (port->tx_policy == UartTxBlock && !uart_tx_can_pump(port))) {
+		written = queue_enqueue_n(tx_queue, data, length);
+	} else if (port->tx_policy == UartTxBlock) {
+		while (1) {
+			written += queue_enqueue_n(tx_queue, data + written, space < length - written ? space : length - written);
+			if (written == length) {
+				break;
+			}
+			if (!port->dma_active) {
+				SET_BIT(port->hw->usart->CR1, USART_CR1_TXEIE);
+			}
+			// Let pending interrupts in (including our own TXE) before
+			// moving a byte out by hand, in case they are masked here.
+			__set_PRIMASK(primask);
+			__disable_irq();
+			uart_tx_pump(port);
+			space = tx_queue->size - queue_count(tx_queue);
+		}
+	}
+	// UartTxDrop: a message that doesn't fit is discarded whole.
+	port->stats.tx_dropped += length - written;
+
+	// While DMA owns the data register, uart_dma_done() hands it back.
+	if (written && !port->dma_active) {
+		SET_BIT(port->hw->usart->CR1, USART_CR1_TXEIE);
+	}
+	__set_PRIMASK(primask);
+	return written;
+}
+
+int uart_writev_dma(const UartSegment *segments, uint32_t count, UartDmaCallback done) {
+	return uart_port_writev_dma(CONSOLE, segments, count, done);
+}
+
+int uart_port_writev_dma(UartPort *port, const UartSegment *segments, uint32_t count, UartDmaCallback done) {
+	uint32_t primask = __get_PRIMASK();
+	UartDmaRequest *request;
+	uint32_t i, last;
+
+	if (count == 0) {
+		return 0;
+	}
+	// Empty segments are skipped, so done goes with the last non-empty one
+	last = count;
+	for (i = 0; i < count; i++) {
+		if (segments[i].length) {
+			last = i;
+		}
+	}
+	if (last == count) {
+		// nothing to send: the buffers are free right away
+		if (done) {
+			done(segments[count - 1].data, 0, 1);
+		}
+		return 1;
+	}
+
+	__disable_irq();
+	if (UART_DMA_QUEUE_LEN - (port->dma_tail - port->dma_head) < count) {
+		__set_PRIMASK(primask);
+		return 0;
+	}
+	for (i = 0; i <= last; i++) {
+		if (segments[i].length == 0) {
+			continue;
+		}
+		request = &port->dma_requests[port->dma_tail % UART_DMA_QUEUE_LEN];
+		request->data = segments[i].data;
+		request->length = segments[i].length;
+		request->start = segments[i].data;
+		request->size = segments[i].length;
+		request->done = (i == last) ? done : 0;
+		request->last = (i == last);
+		port->dma_tail++;
+	}
+	// The TXE interrupt starts the DMA once the queue has drained.
+	if (!READ_BIT(port->hw->usart->CR1, USART_CR1_TXEIE)) {
+		uart_dma_start(port);
+	}
+	__set_PRIMASK(primask);
+	return 1;
+}
+
+int uart_write_dma(const uint8_t *data, uint32_t length, UartDmaCallback done) {
+	return uart_port_write_dma(CONSOLE, data, length, done);
+}
+
+int uart_port_write_dma(UartPort *port, const uint8_t *data, uint32_t length, UartDmaCallback done) {
+	UartSegment segment;
+
+	segment.data = data;
+	segment.length = length;
+	return uart_port_writev_dma(port, &segment, 1, done);
+}
+
+void uart_rx_dma_start(uint8_t *buffer, uint32_t size, UartRxChunkCallback callback) {
+	uart_port_rx_dma_start(CONSOLE, buffer, size, callback);
+}
+
+void uart_port_rx_dma_start(UartPort *port, uint8_t *buffer, uint32_t size, UartRxChunkCallback callback) {
+	const UartHw *hw = port->hw;
+	uint32_t primask = __get_PRIMASK();
+
+	port->rx_dma_buffer = buffer;
+	port->rx_dma_size = size;
+	port->rx_dma_read = 0;
+	port->rx_dma_callback = callback;
+
+	__disable_irq();
+	CLEAR_BIT(hw->usart->CR1, USART_CR1_RXNEIE); // bytes now go to the DMA
+
+	/* DMA receive stream configuration -------------------------------------------*/
+	RCC_AHB1PeriphClockCmd(hw->dma_rcc, ENABLE);
+	hw->rx_stream->CR = 0;
+	while (hw->rx_stream->CR & DMA_SxCR_EN) {
+	}
+	dma_clear_flags(port, hw->rx_stream_index, DMA_ALL_FLAGS);
+	hw->rx_stream->CR = ((uint32_t)hw->rx_channel << DMA_SxCR_CHSEL_Pos) |
+	                    DMA_SxCR_MINC |               // memory increment, 8-bit transfers
+	                    DMA_SxCR_CIRC |               // peripheral to memory, wrapping around
+	                    DMA_SxCR_HTIE | DMA_SxCR_TCIE;
+	hw->rx_stream->PAR = (uint32_t)&hw->usart->DR;
+	hw->rx_stream->M0AR = (uint32_t)buffer;
+	hw->rx_stream->NDTR = size;
+	NVIC_SetPriority(hw->rx_dma_irq, 1); // same as the USART, so the two never pre-empt each other
+	NVIC_ClearPendingIRQ(hw->rx_dma_irq);
+	NVIC_EnableIRQ(hw->rx_dma_irq);
+	hw->rx_stream->CR |= DMA_SxCR_EN;
+
+	hw->usart->CR3 |= USART_CR3_DMAR;
+	SET_BIT(hw->usart->CR1, USART_CR1_IDLEIE); // a quiet line flushes a partial chunk
+	if (port->flow_control) {
+		uart_flow_limits(port);
+	}
+	__set_PRIMASK(primask);
+	uart_port_update_flow(port);
+}
+
+void uart_rx_dma_stop(void) {
+	uart_port_rx_dma_stop(CONSOLE);
+}
+
+void uart_port_rx_dma_stop(UartPort *port) {
+	const UartHw *hw = port->hw;
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	CLEAR_BIT(hw->usart->CR1, USART_CR1_IDLEIE);
+	hw->usart->CR3 &= ~USART_CR3_DMAR;
+	hw->rx_stream->CR &= ~DMA_SxCR_EN;
+	while (hw->rx_stream->CR & DMA_SxCR_EN) {
+	}
+	dma_clear_flags(port, hw->rx_stream_index, DMA_ALL_FLAGS);
+	NVIC_DisableIRQ(hw->rx_dma_irq);
+	port->rx_dma_buffer = 0;
+	port->rx_dma_callback = 0;
+	SET_BIT(hw->usart->CR1, USART_CR1_RXNEIE); // back to a byte per interrupt
+	if (port->flow_control) {
+		uart_flow_limits(port);
+	}
+	__set_PRIMASK(primask);
+	uart_port_update_flow(port);
+}
+
+// Passes received bytes to the chunk callback, or buffers them.
+static void uart_rx_deliver(UartPort *port, const uint8_t *data, uint32_t length) {
+	port->stats.rx_bytes += length;
+	if (port->rx_dma_callback) {
+		port->rx_dma_callback(data, length);
+	} else {
+		queue_enqueue_n(&port->rx_queue, data, length);
+	}
+	uart_port_update_flow(port);
+}
+
+// Hands everything the DMA wrote since the last call on, split in two
+// at the end of the circular buffer.
+static void uart_rx_dma_deliver(UartPort *port) {
+	uint32_t write = port->rx_dma_size - port->hw->rx_stream->NDTR;
+	uint32_t read = port->rx_dma_read;
+
+	if (write == port->rx_dma_size) {
+		write = 0;
+	}
+	if (write == read || !port->rx_dma_buffer) {
+		return;
+	}
+	if (write > read) {
+		uart_rx_deliver(port, port->rx_dma_buffer + read, write - read);
+	} else {
+		uart_rx_deliver(port, port->rx_dma_buffer + read, port->rx_dma_size - read);
+		if (write) {
+			uart_rx_deliver(port, port->rx_dma_buffer, write);
+		}
+	}
+	port->rx_dma_read = write;
+}
+
+uint32_t uart_port_read(UartPort *port, uint8_t *data, uint32_t length) {
+	length = queue_dequeue_n(&port->rx_queue, data, length);
+	uart_port_update_flow(port);
+	return length;
+}
+
+void uart_get_stats(UartStats *stats) {
+	uart_port_get_stats(CONSOLE, stats);
+}
+
+void uart_port_get_stats(UartPort *port, UartStats *stats) {
+	*stats = port->stats;
+}
+
+void uart_reset_stats(void) {
+	uart_port_reset_stats(CONSOLE);
+}
+
+void uart_port_reset_stats(UartPort *port) {
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	port->stats.rx_bytes = 0;
+	port->stats.tx_bytes = 0;
+	port->stats.tx_dropped = 0;
+	port->stats.overrun = 0;
+	port->stats.framing = 0;
+	port->stats.noise = 0;
+	port->stats.parity = 0;
+	port->stats.throttled = 0;
+	port->stats.tx_errors = 0;
+	__set_PRIMASK(primask);
+}
+
+void uart_set_error_callback(void (*callback)(uint32_t errors)) {
+	uart_port_set_error_callback(CONSOLE, callback);
+}
+
+void uart_port_set_error_callback(UartPort *port, void (*callback)(uint32_t errors)) {
+	port->error_callback = callback;
+}
+
+void uart_flush(void) {
+	uart_port_flush(CONSOLE);
+}
+
+void uart_port_flush(UartPort *port) {
+	uint32_t primask = __get_PRIMASK();
+
+	if (!uart_tx_can_pump(port)) {
+		return; // the transmit interrupt can't run until we return
+	}
+	while (!queue_is_empty(&port->tx_queue) || port->dma_head != port->dma_tail) {
+		__disable_irq();
+		uart_tx_pump(port);
+		__set_PRIMASK(primask);
+	}
+	while(USART_GetFlagStatus(port->hw->usart, USART_FLAG_TC) == RESET) {
+	}		// Wait for the last byte to leave the shift register
 }
 
 void uart_set_rx_callback(void (*callback)(uint8_t)) {
+	uart_port_set_rx_callback(CONSOLE, callback);
+}
+
+void uart_port_set_rx_callback(UartPort *port, void (*callback)(uint8_t c)) {
 	// Set up and enable the interrupt.
-	
+
 	// The callback function should be stored in an internal
 	// static function pointer.
-	
+
 	// Whenever a character is received by the UART peripheral,
 	// the callback function should be executed with the
 	// parameter equalling the received character.
-	
-	UART_callback = callback;
-	USART2->CR1|=USART_CR1_RXNEIE;
-	
-	//Enable the USART interrupt
+
+	port->rx_callback = callback;
+
+	//Enable interrupts (the USART interrupt is enabled by uart_port_init)
 	__enable_irq();
-	NVIC_SetPriority(USART2_IRQn,1); // We set this in order for the button press to have higher priority
-	NVIC_ClearPendingIRQ(USART2_IRQn);
-	NVIC_EnableIRQ(USART2_IRQn);
 }
 
 void uart_tx(uint8_t c) {
-	while(USART_GetFlagStatus(USART2, USART_FLAG_TXE) == RESET) {
-	}		// Wait for Empty
-  USART_SendData(USART2, c); // Echo Char
+	uart_port_write(CONSOLE, &c, 1);
 }
 
 uint8_t uart_rx(void) {
-	uint16_t Data;
-	while(USART_GetFlagStatus(USART2, USART_FLAG_RXNE) == RESET) {
+	return uart_port_rx(CONSOLE);
+}
+
+uint8_t uart_port_rx(UartPort *port) {
+	uint8_t c;
+
+	while (!queue_dequeue(&port->rx_queue, &c)) {
 	}		// Wait for Char
-	Data = USART_ReceiveData(USART2); // Collect Char
-	return Data;
+	uart_port_update_flow(port);
+	return c;
 }
 
-void USART2_IRQHandler(void){
-	NVIC_ClearPendingIRQ(USART2_IRQn);
-	if (READ_BIT(USART2->SR, USART_SR_RXNE)) {
+// Shared body of the USARTx interrupt handlers.
+static void uart_irq(UartPort *port) {
+	USART_TypeDef *usart = port->hw->usart;
+	uint8_t c;
+	uint32_t sr = usart->SR;
+	uint32_t errors = 0;
+
+	NVIC_ClearPendingIRQ(port->hw->irq);
+	if (sr & USART_SR_ERRORS) {
+		// receive error, count it and tell whoever is interested
+		if (sr & USART_SR_ORE) { port->stats.overrun++; errors |= UART_ERROR_OVERRUN; }
+		if (sr & USART_SR_FE)  { port->stats.framing++; errors |= UART_ERROR_FRAMING; }
+		if (sr & USART_SR_NE)  { port->stats.noise++;   errors |= UART_ERROR_NOISE; }
+		if (sr & USART_SR_PE)  { port->stats.parity++;  errors |= UART_ERROR_PARITY; }
+		if (port->error_callback) {
+			port->error_callback(errors);
+		}
+		// The flags clear when DR is read after SR. If a byte is waiting
+		// its read (below, or by the DMA) does that, otherwise read DR
+		// here so a lone overrun doesn't keep the interrupt asserted.
+		if (!(sr & USART_SR_RXNE)) {
+			(void)usart->DR;
+		}
+	}
+	// RXNE is also seen briefly while the DMA is receiving; leave those
+	// bytes to the DMA.
+	if (READ_BIT(usart->CR1, USART_CR1_RXNEIE) && (sr & USART_SR_RXNE)) {
 		// received a character
-		UART_callback(uart_rx());
+		c = (uint8_t)usart->DR;
+		port->stats.rx_bytes++;
+		if (port->rx_callback) {
+			port->rx_callback(c);
+		} else {
+			queue_enqueue(&port->rx_queue, c);
+		}
+		uart_port_update_flow(port);
+	}
+	if (READ_BIT(usart->CR1, USART_CR1_IDLEIE) && (sr & USART_SR_IDLE)) {
+		// the line went quiet, deliver what has arrived so far
+		(void)usart->DR; // reading SR then DR clears IDLE
+		uart_rx_dma_deliver(port);
+	}
+	if (READ_BIT(usart->CR1, USART_CR1_TXEIE) && READ_BIT(usart->SR, USART_SR_TXE)) {
+		// ready for the next character
+		if (queue_dequeue(&port->tx_queue, &c)) {
+			usart->DR = c;
+			port->stats.tx_bytes++;
+		} else {
+			// Re-check with interrupts masked: a higher priority ISR may
+			// have queued a byte (and set TXEIE) since the dequeue.
+			__disable_irq();
+			if (queue_is_empty(&port->tx_queue)) {
+				CLEAR_BIT(usart->CR1, USART_CR1_TXEIE);
+				uart_dma_start(port);
+			}
+			__enable_irq();
+		}
+	}
+}
+
+// Shared body of the receive DMA stream interrupt handlers.
+static void uart_rx_dma_irq(UartPort *port) {
+	NVIC_ClearPendingIRQ(port->hw->rx_dma_irq);
+	// half or all of the circular buffer has been filled
+	dma_clear_flags(port, port->hw->rx_stream_index, DMA_HTIF | DMA_TCIF);
+	uart_rx_dma_deliver(port);
+}
+
+// Shared body of the transmit DMA stream interrupt handlers.
+static void uart_tx_dma_irq(UartPort *port) {
+	NVIC_ClearPendingIRQ(port->hw->tx_dma_irq);
+	if (dma_flags(port, port->hw->tx_stream_index) & (DMA_TCIF | DMA_TEIF)) {
+		// transfer finished, or stopped by a transfer error
+		uart_dma_done(port);
 	}
 }
 
+void USART1_IRQHandler(void) {
+	uart_irq(&ports[UartUsart1]);
+}
+
+void USART2_IRQHandler(void) {
+	uart_irq(&ports[UartUsart2]);
+}
+
+void USART6_IRQHandler(void) {
+	uart_irq(&ports[UartUsart6]);
+}
+
+void DMA2_Stream2_IRQHandler(void) {
+	uart_rx_dma_irq(&ports[UartUsart1]);
+}
+
+void DMA2_Stream7_IRQHandler(void) {
+	uart_tx_dma_irq(&ports[UartUsart1]);
+}
+
+void DMA1_Stream5_IRQHandler(void) {
+	uart_rx_dma_irq(&ports[UartUsart2]);
+}
+
+void DMA1_Stream6_IRQHandler(void) {
+	uart_tx_dma_irq(&ports[UartUsart2]);
+}
+
+void DMA2_Stream1_IRQHandler(void) {
+	uart_rx_dma_irq(&ports[UartUsart6]);
+}
+
+void DMA2_Stream6_IRQHandler(void) {
+	uart_tx_dma_irq(&ports[UartUsart6]);
+}
+
 // *******************************ARM University Program Copyright © ARM Ltd 2016*************************************   
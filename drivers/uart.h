@@ -2,44 +2,392 @@
  * \file      uart.h
  * \brief     Controller for a hardware UART module.
  * \copyright ARM University Program &copy; ARM Ltd 2014.
+ *
+ * Each of USART1, USART2 and USART6 is driven through its own UartPort
+ * handle (see uart_get()) with separate buffers, callbacks and
+ * counters. The functions without a port argument operate on the
+ * console port, UART_CONSOLE.
  */
 #ifndef UART_H
 #define UART_H
 #include <stdint.h>
+#include "queue.h"
+
+/*! Size of the transmit buffer in bytes (a power of two). */
+#ifndef UART_TX_BUFFER_SIZE
+#define UART_TX_BUFFER_SIZE 256
+#endif
+
+/*! Size of the receive buffer in bytes (a power of two). */
+#ifndef UART_RX_BUFFER_SIZE
+#define UART_RX_BUFFER_SIZE 128
+#endif
+
+/*! Longest message uart_printf() sends, in characters plus one. The
+ *  message is formatted on the stack of the caller.
+ */
+#ifndef UART_PRINTF_MAX
+#define UART_PRINTF_MAX 128
+#endif
+
+/*! Maximum amount of buffers (or segments) queued for DMA transmission. */
+#ifndef UART_DMA_QUEUE_LEN
+#define UART_DMA_QUEUE_LEN 8
+#endif
+
+/*! The USART peripherals the driver can operate. */
+typedef enum {
+	UartUsart1, //!< USART1 on PA9 (TX) / PA10 (RX).
+	UartUsart2, //!< USART2 on PA2 (TX) / PA3 (RX), the ST-LINK virtual COM port.
+	UartUsart6, //!< USART6 on PC6 (TX) / PC7 (RX).
+	UART_PORTS  //!< Amount of ports.
+} UartId;
+
+/*! Port used by the functions without a port argument. */
+#define UART_CONSOLE UartUsart2
+
+/*! Handle of one UART port. Obtained with uart_get(). */
+typedef struct UartPort UartPort;
+
+/*! Receive error flags passed to the error callback. */
+#define UART_ERROR_OVERRUN 0x1 //!< A byte arrived before the previous one was read; it was lost.
+#define UART_ERROR_FRAMING 0x2 //!< A stop bit was missing (baud mismatch, break or line noise).
+#define UART_ERROR_NOISE   0x4 //!< Noise was detected while sampling a bit.
+#define UART_ERROR_PARITY  0x8 //!< The parity bit didn't match.
+
+/*! Traffic and error counters of the UART. Byte counts tell how much
+ *  the driver moved; the error counts tell how much went wrong on the
+ *  wire or in the receiver hardware.
+ */
+typedef struct {
+	uint32_t rx_bytes;   //!< Bytes received and handed to the application.
+	uint32_t tx_bytes;   //!< Bytes handed to the transmitter.
+	uint32_t tx_dropped; //!< Bytes discarded by the UartTxDrop / UartTxTruncate policies.
+	uint32_t overrun;    //!< Overrun errors (UART_ERROR_OVERRUN).
+	uint32_t framing;    //!< Framing errors (UART_ERROR_FRAMING).
+	uint32_t noise;      //!< Noise errors (UART_ERROR_NOISE).
+	uint32_t parity;     //!< Parity errors (UART_ERROR_PARITY).
+	uint32_t throttled;  //!< Times RTS was raised to stop the sender.
+	uint32_t tx_errors;  //!< DMA transfer errors; each abandons the rest of its message.
+} UartStats;
+
+/*! Receives a chunk of bytes in circular-DMA receive mode. Called
+ *  from interrupt context; the bytes must be consumed (or copied)
+ *  before returning.
+ */
+typedef void (*UartRxChunkCallback)(const uint8_t *data, uint32_t length);
+
+/*! Largest baud rate error, in parts per million, that uart_init_config()
+ *  accepts. Leaves margin for the other end's clock within the ~3.5%
+ *  total the receiver tolerates.
+ */
+#ifndef UART_BAUD_TOLERANCE_PPM
+#define UART_BAUD_TOLERANCE_PPM 20000
+#endif
+
+/*! Receiver oversampling. 8x doubles the highest reachable baud rate
+ *  (PCLK / 8) at the cost of some noise tolerance.
+ */
+typedef enum {
+	UartOversample16, //!< 16 samples per bit (reset default).
+	UartOversample8   //!< 8 samples per bit.
+} UartOversampling;
+
+/*! Output speed of the TX/RX pins, in the GPIO driver's terms. */
+typedef enum {
+	UartPinSpeedLow,    //!< 2 MHz.
+	UartPinSpeedMedium, //!< 25 MHz.
+	UartPinSpeedFast,   //!< 50 MHz.
+	UartPinSpeedHigh    //!< 100 MHz.
+} UartPinSpeed;
+
+/*! Flow control of the port. */
+typedef enum {
+	UartFlowNone,  //!< No flow control (reset default).
+	UartFlowRtsCts //!< RTS/CTS: RTS follows the receive buffer's fill
+	               //!< level (see uart_port_set_flow_queue()), CTS
+	               //!< pauses the transmitter. USART1 and USART2 only.
+} UartFlowControl;
+
+/*! Bytes the sender may still send after RTS is raised (its transmit
+ *  FIFO and the byte on the wire).
+ */
+#ifndef UART_FLOW_MARGIN
+#define UART_FLOW_MARGIN 16
+#endif
+
+/*! Fill level of the watched receive buffer at which RTS is raised.
+ *  The rest of the buffer must hold what the receive DMA buffer
+ *  (\a held bytes, 0 without receive DMA) may still deliver at once,
+ *  plus UART_FLOW_MARGIN. A buffer too small for that raises RTS at
+ *  its first byte.
+ */
+#ifndef UART_FLOW_HIGH
+#define UART_FLOW_HIGH(size, held) \
+	((size) > (held) + UART_FLOW_MARGIN ? (size) - (held) - UART_FLOW_MARGIN : 1)
+#endif
+
+/*! Fill level at which RTS is lowered again. */
+#ifndef UART_FLOW_LOW
+#define UART_FLOW_LOW(size) ((size) / 4)
+#endif
+
+/*! Line settings for uart_init_config(). */
+typedef struct {
+	uint32_t baud;                 //!< Requested baud rate.
+	UartOversampling oversampling; //!< Receiver oversampling.
+	UartPinSpeed pin_speed;        //!< Output speed of the pins.
+	UartFlowControl flow_control;  //!< Flow control.
+} UartConfig;
+
+/*! The baud rate actually programmed into the peripheral. */
+typedef struct {
+	uint32_t requested; //!< Requested baud rate.
+	uint32_t achieved;  //!< Baud rate the programmed divider produces.
+	int32_t error_ppm;  //!< (achieved - requested) / requested, in parts per million.
+	uint32_t pclk;      //!< Peripheral clock the divider is applied to, in Hz.
+	uint32_t brr;       //!< Value written to the BRR register.
+} UartBaudReport;
+
+/*! What a write does when the transmit buffer can't hold all of it. */
+typedef enum {
+	UartTxBlock,    //!< Wait until the whole message has been queued (default).
+	                //!< From an interrupt that pre-empted the port's own
+	                //!< transmit interrupts, acts as UartTxTruncate.
+	UartTxDrop,     //!< Discard the whole message.
+	UartTxTruncate  //!< Queue as much as fits and discard the rest.
+} UartTxPolicy;
+
+/*! One contiguous piece of a scatter-gather DMA transmission. */
+typedef struct {
+	const uint8_t *data; //!< Start of the piece.
+	uint32_t length;     //!< Amount of bytes in the piece.
+} UartSegment;
+
+/*! Called from the DMA interrupt (or with interrupts masked from a
+ *  blocking write or flush) once a submitted buffer has been
+ *  transferred, or given up on, and may be reused. Receives the buffer
+ *  as submitted, and true (1) if it was sent whole or false (0) if a
+ *  DMA transfer error cut the message short.
+ */
+typedef void (*UartDmaCallback)(const uint8_t *data, uint32_t length, int ok);
+
+/*! \brief Returns the handle of a port.
+ *  \param id  Port to get.
+ *  \return Handle of the port.
+ */
+UartPort *uart_get(UartId id);
 
 /*! \brief Initialises the UART controller.
+ *  Uses 16x oversampling unless the rate needs 8x, and faster pins
+ *  above 230400 baud.
  *  \param baud  Baud rate to be used (symbols per second).
  */
 void uart_init(uint32_t baud);
 
+/*! \brief Initialises the UART controller with explicit line settings.
+ *  The baud rate divider is computed with integer arithmetic from the
+ *  current peripheral clock.
+ *  \param config  Line settings.
+ *  \param report  Filled with the achieved baud rate and its error.
+ *                 May be null; see also uart_get_baud_report().
+ *  \return True (1) if the achieved rate is within
+ *          UART_BAUD_TOLERANCE_PPM of the requested one and the
+ *          requested flow control is available, false (0) otherwise
+ *          (the UART is configured either way, without flow control
+ *          if it isn't available).
+ */
+int uart_init_config(const UartConfig *config, UartBaudReport *report);
+
+/*! \brief Initialises a port with explicit line settings.
+ *  See uart_init_config(); received bytes are buffered in the port's
+ *  receive buffer (see uart_port_read()) until a callback is set.
+ */
+int uart_port_init(UartPort *port, const UartConfig *config, UartBaudReport *report);
+
+/*! \brief Returns the baud rate achieved by the last initialisation.
+ *  \param report  Filled with the achieved baud rate and its error.
+ */
+void uart_get_baud_report(UartBaudReport *report);
+
 /*! \brief Enables UART transmission and reception.
  */
 void uart_enable(void);
 
 /*! \brief Transmit a single character.
+ *  The character is queued and sent from the transmit interrupt.
  *  \param c  Character to be sent.
  */
 void uart_tx(uint8_t c);
 
-/*! \brief Receive a single character.
+/*! \brief Transmit a block of bytes.
+ *  The bytes are copied into the transmit buffer and sent from the
+ *  transmit interrupt, so this returns as soon as the copy is done.
+ *  Safe to call from the main loop and from any ISR. When the buffer
+ *  is full the current UartTxPolicy applies.
+ *  \param data    Bytes to be sent.
+ *  \param length  Amount of bytes to send.
+ *  \return Amount of bytes queued.
+ */
+uint32_t uart_write(const uint8_t *data, uint32_t length);
+
+/*! \brief Selects what happens when a write doesn't fit in the
+ *         transmit buffer.
+ *  \param policy  New policy.
+ */
+void uart_set_tx_policy(UartTxPolicy policy);
+
+/*! \brief Transmit a buffer through DMA, without copying it.
+ *  Submissions are queued and sent back to back. The transmit buffer
+ *  used by uart_write() is never interleaved with a DMA buffer; the two
+ *  take turns between buffers.
+ *  \param data    Bytes to be sent. Must stay untouched until \a done runs.
+ *  \param length  Amount of bytes to send.
+ *  \param done    Completion callback, may be null.
+ *  \return True (1) if the buffer was queued, false (0) if the DMA
+ *          queue is full.
+ */
+int uart_write_dma(const uint8_t *data, uint32_t length, UartDmaCallback done);
+
+/*! \brief Transmit several buffers through DMA as one message.
+ *  The segments are sent back to back, in order, and \a done runs once
+ *  after the last non-empty one with that segment as its argument. If
+ *  every segment is empty, \a done runs before returning.
+ *  \param segments  Pieces of the message.
+ *  \param count     Amount of pieces.
+ *  \param done      Completion callback, may be null.
+ *  \return True (1) if every segment was queued, false (0) if the DMA
+ *          queue can't hold them all (nothing is queued then).
+ */
+int uart_writev_dma(const UartSegment *segments, uint32_t count, UartDmaCallback done);
+
+/*! \brief Receive through DMA into a circular buffer.
+ *  Replaces the per-character receive interrupt: the port's receive
+ *  DMA stream (DMA1 Stream5 for the console) fills
+ *  \a buffer continuously and \a callback receives the new bytes when
+ *  half of the buffer fills, when all of it fills, and when the line
+ *  goes idle for one character time after a burst.
+ *  \param buffer    Circular receive buffer, owned by the driver until
+ *                   uart_rx_dma_stop().
+ *  \param size      Size of \a buffer in bytes (at most 65535).
+ *  \param callback  Chunk callback. If null, the bytes are buffered for
+ *                   uart_port_read() instead.
+ */
+void uart_rx_dma_start(uint8_t *buffer, uint32_t size, UartRxChunkCallback callback);
+
+/*! \brief Leaves circular-DMA receive mode. The callback set with
+ *         uart_set_rx_callback(), or the receive buffer, is used again.
+ */
+void uart_rx_dma_stop(void);
+
+/*! \brief Copies the traffic and error counters.
+ *  \param stats  Filled with the current counters.
+ */
+void uart_get_stats(UartStats *stats);
+
+/*! \brief Clears the traffic and error counters. */
+void uart_reset_stats(void);
+
+/*! \brief Passes a callback function to the API which is executed during
+ *         the interrupt handler whenever a receive error is detected.
+ *  \param callback  Callback function, receiving a mask of UART_ERROR_*
+ *                   flags. May be null.
+ */
+void uart_set_error_callback(void (*callback)(uint32_t errors));
+
+/*! \brief Waits until every queued byte has been transmitted. Returns
+ *         at once from an interrupt that pre-empted the port's own
+ *         transmit interrupts, which can't make progress meanwhile.
+ */
+void uart_flush(void);
+
+/*! \brief Receive a single character from the receive buffer.
  *  \warning This function blocks until a character is
  *           available. For a non-blocking receive, see
- *           uart_set_rx_callback().
+ *           uart_set_rx_callback(). Characters given to a callback
+ *           never reach the receive buffer.
  *  \return Received character.
  */
 uint8_t uart_rx(void);
 
 /*! \brief Transmit a null terminated string.
+ *  Equivalent to uart_write() on the characters of the string.
  *  \param str  String to be sent.
  */
 void uart_print(char *str);
 
+/*! \brief Transmit formatted text.
+ *  Formats with the allocation-free formatter of format.h (%c, %d, %u,
+ *  %x, %s with flags and width) into a stack buffer of UART_PRINTF_MAX
+ *  characters and queues it with a single uart_write(), so output from
+ *  other contexts can't land in the middle of it (unless a blocking
+ *  write has to wait for room). Longer output is truncated. Like
+ *  uart_write(), it may be used from interrupt handlers.
+ *  \param format  Format string, see format.h.
+ *  \return Amount of characters formatted. Beyond UART_PRINTF_MAX - 1,
+ *          or with the UartTxDrop and UartTxTruncate policies, some
+ *          may have been dropped.
+ */
+uint32_t uart_printf(const char *format, ...);
+
 /*! \brief Passes a callback function to the API which is executed during
  *         the receive interrupt handler.
- *  \param callback  Callback function.
+ *  \param callback  Callback function. If null, received characters
+ *                   are buffered instead.
  */
 void uart_set_rx_callback(void (*callback)(uint8_t c));
 
+/*! \name Per-port variants
+ *  Same as the functions of the same name without \c port_, applied to
+ *  \a port instead of the console.
+ *  @{
+ */
+void uart_port_enable(UartPort *port);
+void uart_port_get_baud_report(UartPort *port, UartBaudReport *report);
+uint32_t uart_port_write(UartPort *port, const uint8_t *data, uint32_t length);
+void uart_port_print(UartPort *port, const char *str);
+uint32_t uart_port_printf(UartPort *port, const char *format, ...);
+void uart_port_set_tx_policy(UartPort *port, UartTxPolicy policy);
+int uart_port_write_dma(UartPort *port, const uint8_t *data, uint32_t length, UartDmaCallback done);
+int uart_port_writev_dma(UartPort *port, const UartSegment *segments, uint32_t count, UartDmaCallback done);
+void uart_port_rx_dma_start(UartPort *port, uint8_t *buffer, uint32_t size, UartRxChunkCallback callback);
+void uart_port_rx_dma_stop(UartPort *port);
+void uart_port_get_stats(UartPort *port, UartStats *stats);
+void uart_port_reset_stats(UartPort *port);
+void uart_port_set_error_callback(UartPort *port, void (*callback)(uint32_t errors));
+void uart_port_flush(UartPort *port);
+uint8_t uart_port_rx(UartPort *port);
+void uart_port_set_rx_callback(UartPort *port, void (*callback)(uint8_t c));
+/*! @} */
+
+/*! \brief Takes up to \a length bytes out of the port's receive buffer.
+ *  Never blocks.
+ *  \param port    Port to read from.
+ *  \param data    Array the bytes are copied to.
+ *  \param length  Maximum amount of bytes to read.
+ *  \return Amount of bytes read.
+ */
+uint32_t uart_port_read(UartPort *port, uint8_t *data, uint32_t length);
+
+/*! \brief Selects the buffer whose fill level drives RTS.
+ *  RTS is raised when the buffer reaches UART_FLOW_HIGH and lowered
+ *  when it drains to UART_FLOW_LOW; both follow the receive DMA buffer
+ *  size as it is started and stopped. By default this is the port's own
+ *  receive buffer. An application that moves the received bytes into
+ *  its own queue (from a receive callback) selects that queue instead,
+ *  and calls uart_port_update_flow() after taking bytes out of it.
+ *  \param port   Port to operate on.
+ *  \param queue  Buffer to watch, or null for the port's receive buffer.
+ */
+void uart_port_set_flow_queue(UartPort *port, Queue *queue);
+
+/*! \brief Re-evaluates RTS against the watched buffer's fill level.
+ *  Done by the driver after every reception and by uart_port_read() and
+ *  uart_port_rx(). Does nothing without flow control.
+ *  \param port  Port to operate on.
+ */
+void uart_port_update_flow(UartPort *port);
+
 #endif // UART_H
 
 // *******************************ARM University Program Copyright © ARM Ltd 2016*************************************   
@@ -0,0 +1,28 @@
+/*!
+ * \file      log_messages.h
+ * \brief     Table of the log messages of the application.
+ *
+ * Shared by the firmware and the host decoder (tools/logdecode), so
+ * both agree on the number of every message. Only add messages at the
+ * end, or rebuild both after a change.
+ */
+#ifndef LOG_MESSAGES_H
+#define LOG_MESSAGES_H
+
+/*! X(name, format) for every message, in the order of their numbers. */
+#define LOG_MESSAGES(X) \
+	X(LOG_DIGIT_TOGGLE,  "Digit %c -> Toggle LED\r\n") \
+	X(LOG_DIGIT_BLINK,   "Digit %c -> Blink LED\r\n") \
+	X(LOG_DIGIT_SKIPPED, "Digit %c -> Skipped LED action\r\n") \
+	X(LOG_BUTTON,        "Interrupt: Button pressed. LED locked. Count = %u\r\n")
+
+#define LOG_MESSAGE_ID(name, format) name,
+#define LOG_MESSAGE_FORMAT(name, format) format,
+
+/*! Numbers of the log messages. */
+enum {
+	LOG_MESSAGES(LOG_MESSAGE_ID)
+	LOG_MESSAGE_COUNT
+};
+
+#endif // LOG_MESSAGES_H
@@ -1,11 +1,21 @@
 #include "platform.h"
-#include <stdio.h>
 #include <stdint.h>
 #include "uart.h"
 #include <string.h>
 #include "queue.h"
 #include "gpio.h"
-#include "timer.h"
+#include "clock.h"
+#include "swtimer.h"
+#include "timer_hw.h"
+#include "capture.h"
+#include "delay.h"
+#include "sleep.h"
+#include "event.h"
+#include "line.h"
+#include "log.h"
+#include "log_messages.h"
+#include "frame.h"
+#include "protocol.h"
 
 
 /*
@@ -33,8 +43,10 @@ stored in the variables:
 P_LED_R, P_SW  
 
 
-For the reading of the characters every 0.5sec the SysTick timer interupt is used.
-For the LED blinking the RCC_APB1Periph_TIM2 timer is used.
+For the reading of the characters every 0.5sec a software timer (swtimer.c,
+running tickless on TIM5) is used.
+For the LED blinking the TIM2 timer is used (timer_hw.c): P_LED_R is TIM2
+channel 1, so the timer toggles the pin itself and blinking needs no interrupt.
 
 
 When the stage is that of character input, the button presses do nothing
@@ -44,11 +56,14 @@ A variable named frozen indicates if the LED is frozen, and a variable
 named input_phase indicates if we are currently on the character input phase.
 
 
-The action happens inside the interrupt's ISRs.
+The LED actions happen inside the interrupt's ISRs. The ISRs then post an
+event to the events queue and the main loop prints the matching message, so
+no formatting or UART output happens in interrupt context.
 
 
 The priorities are acounted so that the button interrupt is above everything,
-then the keyboard interrupt and then the SysTick and the TIM2.
+then the keyboard interrupt and then the digit timer (TIM5). The TIM2
+blinking uses no interrupt.
 This way if the button is pressed, the LED freezes before its state is changed
 and if a key is pressed during the analysis, the analysis stops immediately.
 
@@ -65,10 +80,22 @@ Other files that also have changes are:
 /*         UART variable definitions         */
 #define BUFF_SIZE 128 //read buffer length
 
-Queue rx_queue;       // Queue for storing received characters
+QUEUE_DEFINE(rx_queue, 256); // Queue for storing received characters
+uint8_t rx_dma_buffer[64];    // Circular buffer the UART receive DMA writes to
 char buff[BUFF_SIZE]; // The UART read string will be stored here
+Line line;            // Echoes and edits the input, fills buff
 int current_digit = 0;          // The index of the digit being analysed
 int input_phase = 1;  // input_phase = 1 if we are at the stage of inputing numbers
+SwTimer digit_timer;  // Periodic timer analysing one digit every 0.5 sec
+TimerHw *blink_timer; // TIM2, toggles the LED every 200 ms on even digits
+#define LED_CHANNEL 1 // TIM2 channel 1 drives P_LED_R
+
+
+
+/*       Binary protocol variable definitions, see protocol.h        */
+FrameReceiver frame_rx;        // Decodes the frames received in binary mode
+uint8_t frame_out[FRAME_MAX_ENCODED]; // The frame being sent
+volatile int binary_mode = 0;  // binary_mode = 1 once a zero byte is received
 
 
 
@@ -78,23 +105,240 @@ unsigned int button_press_count = 0;   // amount of button presses since the las
 
 
 
+/*       Events posted by the ISRs to the main loop         */
+#define EVENT_DIGIT  1  // payload: digit character | (digit action << 8)
+#define EVENT_BUTTON 2  // payload: button press count
+
+#define DIGIT_TOGGLE  0 // odd digit, LED toggled
+#define DIGIT_BLINK   1 // even digit, LED blinking
+#define DIGIT_SKIPPED 2 // LED frozen, action skipped
+
+EVENT_QUEUE_DEFINE(events, 16);
+
+
+
+/*       Log messages, see log_messages.h        */
+// Build with LOG_MODE=LogTokens to send them as token records and
+// read the console through tools/logdecode
+#ifndef LOG_MODE
+#define LOG_MODE LogText
+#endif
+
+static const char *const log_formats[] = { LOG_MESSAGES(LOG_MESSAGE_FORMAT) };
+
+
+
+/*       Prints the occupancy and loss counters of rx_queue and the UART       */
+void print_rx_stats(void) {
+	QueueStats stats;
+	UartStats uart;
+	
+	queue_get_stats(&rx_queue, &stats);
+	uart_printf("RX queue: max %u/%u, received %u, dropped %u, full for %u us\r\n",
+	            stats.high_watermark, rx_queue.size, stats.enqueued, stats.dropped,
+	            (uint32_t)(stats.full_cycles / (SystemCoreClock / 1000000)));
+	
+	uart_get_stats(&uart);
+	uart_printf("UART: rx %u, tx %u (%u dropped, %u errors), throttled %u\r\n",
+	            uart.rx_bytes, uart.tx_bytes, uart.tx_dropped, uart.tx_errors, uart.throttled);
+	uart_printf("UART errors: overrun %u, framing %u, noise %u, parity %u\r\n",
+	            uart.overrun, uart.framing, uart.noise, uart.parity);
+}
+
+
+#ifdef BENCHMARK_FORMAT
+#include <stdio.h>
+
+/*       Compares uart_printf with snprintf + uart_print      */
+//       build with BENCHMARK_FORMAT defined to run it at start-up.
+//       The code size of each is listed under "Image component sizes"
+//       in the linker map file.
+void benchmark_format(void) {
+	char display_message[60];
+	uint32_t start, cycles_snprintf, cycles_printf;
+	
+	// Time only formatting and queueing: start with the transmitter idle
+	uart_flush();
+	start = DWT->CYCCNT;
+	snprintf(display_message, sizeof(display_message), "Digit %c -> Toggle LED, count = %u\r\n", '7', 12345u);
+	uart_print(display_message);
+	cycles_snprintf = DWT->CYCCNT - start;
+	
+	uart_flush();
+	start = DWT->CYCCNT;
+	uart_printf("Digit %c -> Toggle LED, count = %u\r\n", '7', 12345u);
+	cycles_printf = DWT->CYCCNT - start;
+	
+	uart_flush();
+	uart_printf("snprintf + uart_print: %u cycles, uart_printf: %u cycles\r\n",
+	            cycles_snprintf, cycles_printf);
+}
+#endif
+
+
+#ifdef DELAY_SELF_TEST
+/*       Checks the busy-wait delays against TIM5       */
+//       build with DELAY_SELF_TEST defined to run it at start-up
+void delay_report(void) {
+	DelayCalibration calibration;
+	int passed = delay_self_test(&calibration);
+	
+	uart_printf("Delay: %u us took %u us (%d ppm): %s\r\n",
+	            calibration.requested_us, calibration.measured_us, calibration.error_ppm,
+	            passed ? "ok" : "FAILED");
+	uart_printf("Delay: core clock %u Hz, call overhead %u cycles\r\n",
+	            calibration.core_clock, calibration.overhead_cycles);
+}
+#endif
+
+
+#ifdef EDGE_CAPTURE
+/*       Times the edges on P_CAPTURE (TIM4 channel 1, DMA, no interrupts)       */
+//       build with EDGE_CAPTURE defined. The button pin (PC13) has no
+//       timer channel, so wire it to PB6 to measure its bounce; an empty
+//       line prints the timing of the edges since the previous one.
+#define P_CAPTURE PB_6
+#define P_CAPTURE_AF_TIM4 2
+
+Capture capture;
+uint32_t capture_buffer[64];
+CaptureMeasurement capture_timing;
+
+void capture_setup(void) {
+	TimerHw *timer = timer_hw_get(TimerHwTim4);
+	
+	timer_hw_init_us(timer, 65536, 0); // 1 us ticks over the full 16 bits
+	timer_hw_start(timer);
+	capture_init(&capture, timer, 1, P_CAPTURE, P_CAPTURE_AF_TIM4, TimerHwBoth,
+	             capture_buffer, sizeof(capture_buffer) / sizeof(capture_buffer[0]));
+}
+
+void print_capture(void) {
+	capture_measure(&capture, &capture_timing);
+	uart_printf("Capture: %u edges, shortest gap %u us, last high %u us, last low %u us\r\n",
+	            capture_timing.edges, capture_timing.shortest_us,
+	            capture_timing.high_us, capture_timing.low_us);
+}
+#endif
+
+
+/*       Characters accepted into the input line       */
+int input_filter(uint8_t c) {
+	// take into acound only numbers and '-', ignore everything else
+	return (c >= '0' && c <= '9') || c == '-';
+}
+
+
+/*       True once a line or a frame has been received       */
+int input_ready(void *context) {
+	return line_ready(&line) || frame_ready(&frame_rx);
+}
+
+
 /*       Interrupt Service Routine for UART receive       */
-void uart_rx_isr(uint8_t rx) {
-	// Check if the received character is a printable ASCII character
-	if (rx >= 0x0 && rx <= 0x7F ) {
-		// Store the received character
-		queue_enqueue(&rx_queue, rx);
+//       called by the receive DMA with every burst of characters
+void uart_rx_isr(const uint8_t *rx, uint32_t length) {
+	uint32_t i = 0;
+	
+	if (!binary_mode) {
+		// A keyboard never sends a zero byte, it is the start of a frame
+		while (i < length && rx[i] != 0) {
+			i++;
+		}
+		// Echo and edit the line, the main loop is woken only by line_ready()
+		line_input(&line, rx, i);
+		if (i == length) {
+			return;
+		}
+		binary_mode = 1;
+	}
+	for (; i < length; i++) {
+		frame_receive(&frame_rx, rx[i]);
+	}
+}
+
+
+/*       Sends a frame to the host       */
+void send_frame(uint8_t type, const uint8_t *payload, uint32_t length) {
+	uart_write(frame_out, frame_encode(type, payload, length, frame_out));
+}
+
+
+/*       Answers the frame waiting in frame_rx       */
+//       returns 1 if it was a digit sequence, which is then stored in buff
+int handle_frame(void) {
+	uint8_t telemetry[PROTOCOL_TELEMETRY_FIELDS * 4];
+	uint32_t values[PROTOCOL_TELEMETRY_FIELDS];
+	uint8_t type = frame_type(&frame_rx);
+	uint8_t status = PROTOCOL_STATUS_OK;
+	const uint8_t *payload;
+	uint32_t length, i;
+	UartStats uart;
+	int digits = 0;
+	
+	payload = frame_payload(&frame_rx, &length);
+	switch (type) {
+		case PROTOCOL_DIGITS:
+			// Accept the same characters as the keyboard input
+			if (length >= BUFF_SIZE) {
+				status = PROTOCOL_STATUS_INVALID;
+			}
+			for (i = 0; i < length && status == PROTOCOL_STATUS_OK; i++) {
+				if (!input_filter(payload[i])) {
+					status = PROTOCOL_STATUS_INVALID;
+				}
+			}
+			if (status == PROTOCOL_STATUS_OK) {
+				memcpy(buff, payload, length);
+				buff[length] = '\0';
+				digits = 1;
+			}
+			send_frame(type | PROTOCOL_REPLY, &status, 1);
+			break;
+		case PROTOCOL_TELEMETRY:
+			uart_get_stats(&uart);
+			values[PROTOCOL_TELEMETRY_RX_BYTES] = uart.rx_bytes;
+			values[PROTOCOL_TELEMETRY_TX_BYTES] = uart.tx_bytes;
+			values[PROTOCOL_TELEMETRY_TX_DROPPED] = uart.tx_dropped;
+			values[PROTOCOL_TELEMETRY_OVERRUN] = uart.overrun;
+			values[PROTOCOL_TELEMETRY_FRAMING] = uart.framing;
+			values[PROTOCOL_TELEMETRY_NOISE] = uart.noise;
+			values[PROTOCOL_TELEMETRY_PARITY] = uart.parity;
+			values[PROTOCOL_TELEMETRY_FRAMES] = frame_rx.frames;
+			values[PROTOCOL_TELEMETRY_FRAME_ERRORS] = frame_rx.errors;
+			values[PROTOCOL_TELEMETRY_BUTTON_PRESSES] = button_press_count;
+			for (i = 0; i < sizeof(telemetry); i++) {
+				telemetry[i] = (uint8_t)(values[i / 4] >> (8 * (i % 4))); // little endian
+			}
+			send_frame(type | PROTOCOL_REPLY, telemetry, sizeof(telemetry));
+			break;
+		case PROTOCOL_TEXT:
+			send_frame(type | PROTOCOL_REPLY, &status, 1);
+			binary_mode = 0;
+			break;
+		default:
+			status = PROTOCOL_STATUS_UNKNOWN;
+			send_frame(type | PROTOCOL_REPLY, &status, 1);
+			break;
 	}
+	frame_release(&frame_rx);
+	return digits;
+}
+
+
+/*      Holds the LED at a level, stopping any blinking      */
+void led_hold(int on) {
+	timer_hw_output_set(blink_timer, LED_CHANNEL, on ? TimerHwOutputActive : TimerHwOutputInactive);
 }
 
 
 /*      Interrupt Sevice Routine for analysing characters      */
-//       using SysTick
-void digit_timer_isr() {
+//       called by the digit_timer software timer
+void digit_timer_isr(void *context) {
 	// analyses the characted in the buffer given by index current_digit
 	// every 0.5sec
 	
-	char display_message[32];   // string holding the message to print (max 32 chars)
+	uint32_t action;
 	
 	if (buff[current_digit] == '-') {
 		// if the character is '-' start from the beginning (first character)
@@ -106,59 +350,67 @@ void digit_timer_isr() {
 		// but only if the LED is not frozen (button pressed an odd amount)
 		
 		if (!frozen) {
-			// Disable the TIM2 timer to stop the LED blinking
-			// Also clear pending interrupts that could be wainting to occur
-			NVIC_ClearPendingIRQ(TIM2_IRQn);  
-			NVIC_DisableIRQ(TIM2_IRQn);     
-			
-			gpio_toggle(P_LED_R);         // toggle the LED
-			sprintf(display_message, "Digit %c -> Toggle LED\r\n", buff[current_digit]);
+			led_hold(!gpio_get(P_LED_R)); // stop the blinking and toggle the LED
+			action = DIGIT_TOGGLE;
 		} else {
 			// button has been pressed, LED is frozen
-			sprintf(display_message, "Digit %c -> Skipped LED action\r\n", buff[current_digit]);
+			action = DIGIT_SKIPPED;
 		}	
 	} else {
-		// the number is even, start the TIM2 timer
+		// the number is even, let TIM2 toggle the LED
 		// but only if the LED is not frozen
 		if (!frozen) {
-			NVIC_EnableIRQ(TIM2_IRQn);   // Eneble TIM2
-			TIM2->CR1 |= TIM_CR1_CEN;	   // Start TIM2
-			sprintf(display_message, "Digit %c -> Blink LED\r\n", buff[current_digit]);
+			timer_hw_output_set(blink_timer, LED_CHANNEL, TimerHwOutputToggle);
+			action = DIGIT_BLINK;
 		} else {
 			// LED is frozen
-			sprintf(display_message, "Digit %c -> Skipped LED action\r\n", buff[current_digit]);
+			action = DIGIT_SKIPPED;
 		}
 	}
-	uart_print(display_message);
+	// the message is printed by the main loop
+	event_post(&events, EVENT_DIGIT, (uint8_t)buff[current_digit] | (action << 8));
 	current_digit++;     // go to next number
 }
 
 
-/*      Interrupt Sevice Routine for LED blinking      */
-void TIM2_IRQHandler(void) {
-	// toggle the LED every 200ms
-	
-	if (TIM2->SR & TIM_SR_UIF) {	// Check if update interrupt flag is set
-		TIM2->SR &= ~TIM_SR_UIF;		// Clear the flag immediately
-		gpio_toggle(P_LED_R);
-	}
-}
-
-
 /*      Interrupt Sevice Routine for button press      */
 void freeze(int status) {
-	char display_message[60];  // string holding the message to print (max 60 chars)
-	
 	// button has been pressed! add one to the count
 	button_press_count++;
 	
 	if (!input_phase) {
 		// we are not on the character input stage
 		
-		NVIC_DisableIRQ(TIM2_IRQn);    // stop the LED timer
+		led_hold(gpio_get(P_LED_R));   // gate the blinking at the current level
 		frozen = !frozen;              // toggle the frozen variable
-		sprintf(display_message, "Interrupt: Button pressed. LED locked. Count = %d\r\n", button_press_count);
-		uart_print(display_message);
+		event_post(&events, EVENT_BUTTON, button_press_count);
+	}
+}
+
+
+/*      Prints the messages of the events posted by the ISRs      */
+void handle_events(void) {
+	Event event;
+	
+	while (event_get(&events, &event)) {
+		switch (event.id) {
+			case EVENT_DIGIT:
+				switch (event.payload >> 8) {
+					case DIGIT_TOGGLE:
+						log_message(LOG_DIGIT_TOGGLE, 1, event.payload & 0xFF);
+						break;
+					case DIGIT_BLINK:
+						log_message(LOG_DIGIT_BLINK, 1, event.payload & 0xFF);
+						break;
+					default:
+						log_message(LOG_DIGIT_SKIPPED, 1, event.payload & 0xFF);
+						break;
+				}
+				break;
+			case EVENT_BUTTON:
+				log_message(LOG_BUTTON, 1, event.payload);
+				break;
+		}
 	}
 }
 
@@ -166,31 +418,64 @@ void freeze(int status) {
 int main() {
 	
 	// Variables to help with UART read / write
-	uint8_t rx_char = 0;
-	uint32_t buff_index;
+	uint32_t buff_index;  // length of the line, including the '\0'
+	UartBaudReport baud;
 	
-	// Initialize the receive queue and UART
-	queue_init(&rx_queue, 128);
+	// Initialize the UART (the receive queue is statically allocated)
+	queue_reset_stats(&rx_queue);
+	event_queue_init(&events);
+	log_init(log_formats, LOG_MESSAGE_COUNT, LOG_MODE);
+	frame_receiver_init(&frame_rx);
+	line_init(&line, uart_get(UART_CONSOLE), &rx_queue, buff, BUFF_SIZE, input_filter);
+#ifdef CONSOLE_FLOW_CONTROL
+	// RTS/CTS on PA1/PA0 (not wired to the ST-LINK, and taken from the
+	// comparator, see platform.h), RTS raised while
+	// rx_queue still has room for all of rx_dma_buffer and the bytes
+	// in flight, so pasted input is never lost
+	{
+		UartConfig config = { 115200, UartOversample16, UartPinSpeedLow, UartFlowRtsCts };
+		uart_init_config(&config, 0);
+		uart_port_set_flow_queue(uart_get(UART_CONSOLE), &rx_queue);
+	}
+#else
 	uart_init(115200);
-	uart_set_rx_callback(uart_rx_isr); // Set the UART receive callback function
+#endif
+	uart_rx_dma_start(rx_dma_buffer, sizeof(rx_dma_buffer), uart_rx_isr); // Receive through DMA, one interrupt per burst
 	uart_enable(); // Enable UART module
 	
 	__enable_irq(); // Enable interrupts
 	
 	uart_print("\r\n");// Print newline
 	
+	// Report the baud rate the divider actually achieves
+	uart_get_baud_report(&baud);
+	uart_printf("UART: %u baud (requested %u, error %d ppm)\r\n",
+	            baud.achieved, baud.requested, baud.error_ppm);
+	
+#ifdef BENCHMARK_FORMAT
+	benchmark_format();
+#endif
+#ifdef EDGE_CAPTURE
+	capture_setup();
+#endif
+	
 	
-	// Initialize the led interrupt timer
-	RCC->APB1ENR |= RCC_APB1ENR_TIM2EN;  // Enable clock for TIM2
-	// set the amount of ticks relative to the clock speed
-	TIM2->PSC = 15999;  // Prescaler: divide 16 MHz by 16000 = 1 kHz
-	TIM2->ARR = 199;   // Auto-reload: 200 ticks at 1 kHz = 200 ms
-	TIM2->DIER |= TIM_DIER_UIE;     // Enable update interrupt (overflow interrupt)
-	NVIC_SetPriority(TIM2_IRQn, 3);  // set the priority 
+	// Start the clock (TIM5) and the software timers on its alarm
+	clock_init();
+	swtimer_service_init();
+	swtimer_init(&digit_timer, digit_timer_isr, 0);
+#ifdef DELAY_SELF_TEST
+	delay_report();
+#endif
 	
-	// Initialize LEDs
-	gpio_set_mode(P_LED_R, Output); // Set onboard LED pin to output
-	gpio_set(P_LED_R, LED_OFF);     // initialise to off
+	// Initialize the LED blinking timer, 200 ms at any clock speed
+	blink_timer = timer_hw_get(TimerHwTim2);
+	timer_hw_init_us(blink_timer, 200000, 0);
+	
+	// Initialize LEDs: the onboard LED is driven by TIM2 channel 1,
+	// held off until an even digit lets it toggle at every period
+	timer_hw_output_init(blink_timer, LED_CHANNEL, P_LED_R, P_LED_R_AF_TIM2, 0);
+	timer_hw_start(blink_timer);
 	
 	// Initialize the Push Button (User Button)
 	gpio_set_mode(P_SW, PullUp);     // St pin to resistive pull-up mode
@@ -203,52 +488,69 @@ int main() {
 	while(1) {
 
 		// Prompt the user to enter a digit sequence
-		uart_print("Input: ");
-		buff_index = 0; // Reset buffer index
-		
-		do {
-			// Wait until a digit or dash is received in the queue
-			while (!queue_dequeue(&rx_queue, &rx_char))
-				__WFI(); // Wait for Interrupt
-
-			if (rx_char == 0x7F) { // Handle backspace character
-				if (buff_index > 0) {
-					buff_index--; // Move buffer index back
-					uart_tx(rx_char); // Send backspace character to erase on terminal
-				}
-			} else if ((rx_char >= '0' && rx_char <= '9') || rx_char == '-' || rx_char == '\r') {
-				// take into acound only numbers, '-' and '\r', ignore everything else
-				// Store and echo the received character back
-				buff[buff_index++] = (char)rx_char; // Store digit or dash in buffer
-				uart_tx(rx_char); // Echo digit or dash back to terminal
-			}
-		} while (rx_char != '\r' && buff_index < BUFF_SIZE); // Continue until Enter key or buffer full
+		if (!binary_mode) {
+			uart_print("Input: ");
+		}
 		
-		// Replace the last character with null terminator to make it a valid C string
-		buff[buff_index - 1] = '\0';
-		uart_print("\r\n"); // Print newline
+		// The receive interrupt echoes and edits the input until Enter
+		// is pressed or the buffer is full, anything typed after it is held.
+		// In binary mode it collects a frame instead
+		line_start(&line);
+		sleep_until(SLEEP_FOREVER, input_ready, 0);
 		
-		// Check if buffer overflow occurred
-		if (buff_index >= BUFF_SIZE) {
-			uart_print("Stop trying to overflow my buffer! I resent that!\r\n");
+		if (frame_ready(&frame_rx)) {
+			// A digit sequence from the host is analysed like a typed one,
+			// anything else has been answered
+			if (!handle_frame()) {
+				continue;
+			}
+			buff_index = strlen(buff) + 1;
+		} else {
+			// buff now holds the null-terminated line
+			buff_index = line.length + 1;
+			uart_print("\r\n"); // Print newline
+			
+			// Check if buffer overflow occurred
+			if (line.overflow) {
+				uart_print("Stop trying to overflow my buffer! I resent that!\r\n");
+			}
+			
+			// An empty line (just Enter) reports the receive queue counters
+			if (buff_index == 1) {
+				print_rx_stats();
+#ifdef EDGE_CAPTURE
+				print_capture();
+#endif
+			}
 		}
 		
 		// Sequence processing
 		input_phase = 0;             // exited input stage
 		current_digit = 0;           // starting to analyse from first character
 		
-		// initialise character timer (SysTick 0.5 sec period)
-		timer_init(500000);          // 500'000 s = 0.5 s
-		timer_set_callback(digit_timer_isr); // set the callback function to the one defined above
-		timer_enable();              // enable
+		// start the character timer (0.5 sec period)
+		swtimer_start(&digit_timer, 500, 500);
 		
 		while (current_digit != buff_index - 1) { 
 			// do until currect character position (current_digit) reaches the end of the buffer
 			// don't account for the last position as it is '\0'
 			
-			__WFI(); // Wait for Interrupt
+			// Wait for Interrupt, unless an event or key arrived meanwhile
+			// (a pending interrupt still wakes __WFI with interrupts masked)
+			__disable_irq();
+			if (event_queue_is_empty(&events) && !line_pending(&line) && !frame_ready(&frame_rx)) {
+				__WFI();
+			}
+			__enable_irq();
+			
+			handle_events();
+			
+			// Requests other than a new digit sequence don't stop the analysis
+			if (frame_ready(&frame_rx) && frame_type(&frame_rx) != PROTOCOL_DIGITS) {
+				handle_frame();
+			}
 			
-			if (!queue_is_empty(&rx_queue)) {
+			if (line_pending(&line) || frame_ready(&frame_rx)) {
 				// queue is not empty, the interupt was a key press, exit the loop to start over..
 				uart_print("...\r\n(New input received)\r\n");
 				break;
@@ -257,11 +559,11 @@ int main() {
 		
 		// the whole number has been processed, or a button was pressed
 		// prepare for next number
-		NVIC_DisableIRQ(TIM2_IRQn);    // disable the LED blinking timer
-		timer_disable();               // disable the character timer
-		gpio_set(P_LED_R, 0);          // set the LED to off
+		swtimer_stop(&digit_timer);    // stop the character timer
+		led_hold(LED_OFF);             // stop the blinking, set the LED to off
 		frozen = 0;                    // unfreeze
 		input_phase = 1;               // enter input stage
+		handle_events();               // print what happened after the last wake-up
 		
 		if (current_digit == buff_index - 1) {
 			// if current position is the last position of the buffer, the whole sequence was proccesed
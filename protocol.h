@@ -0,0 +1,55 @@
+/*!
+ * \file      protocol.h
+ * \brief     Frame types of the binary protocol on the console UART.
+ *
+ * Shared by the firmware and the host tool (tools/frametool). Frames
+ * are built with frame.h. A zero byte received in text mode switches
+ * the console to binary mode (every frame starts with one); a
+ * PROTOCOL_TEXT frame switches it back.
+ *
+ * Every request is answered with a frame of the request's type with
+ * PROTOCOL_REPLY set. The host should wait for it before sending the
+ * next request. Multi-byte values are little endian.
+ */
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+/*! Payload: digits and '-' to analyse, as typed in text mode.
+ *  Reply payload: one PROTOCOL_STATUS_* byte.
+ */
+#define PROTOCOL_DIGITS    0x01
+
+/*! Payload: none.
+ *  Reply payload: PROTOCOL_TELEMETRY_FIELDS 32-bit counters, in the
+ *  order of the PROTOCOL_TELEMETRY_* indices.
+ */
+#define PROTOCOL_TELEMETRY 0x02
+
+/*! Payload: none. Reply payload: one PROTOCOL_STATUS_* byte, after
+ *  which the console is back in text mode.
+ */
+#define PROTOCOL_TEXT      0x03
+
+/*! Set in the type of a reply. */
+#define PROTOCOL_REPLY     0x80
+
+#define PROTOCOL_STATUS_OK      0x00 //!< The request was carried out.
+#define PROTOCOL_STATUS_INVALID 0x01 //!< The payload was rejected.
+#define PROTOCOL_STATUS_UNKNOWN 0x02 //!< The frame type is not known.
+
+/*! Indices of the counters in a PROTOCOL_TELEMETRY reply. */
+enum {
+	PROTOCOL_TELEMETRY_RX_BYTES,
+	PROTOCOL_TELEMETRY_TX_BYTES,
+	PROTOCOL_TELEMETRY_TX_DROPPED,
+	PROTOCOL_TELEMETRY_OVERRUN,
+	PROTOCOL_TELEMETRY_FRAMING,
+	PROTOCOL_TELEMETRY_NOISE,
+	PROTOCOL_TELEMETRY_PARITY,
+	PROTOCOL_TELEMETRY_FRAMES,
+	PROTOCOL_TELEMETRY_FRAME_ERRORS,
+	PROTOCOL_TELEMETRY_BUTTON_PRESSES,
+	PROTOCOL_TELEMETRY_FIELDS
+};
+
+#endif // PROTOCOL_H
@@ -0,0 +1,221 @@
+/*
+ * frametool - reference host side of the binary protocol (see protocol.h)
+ *
+ * Usage: frametool [-b baud] device digits SEQUENCE
+ *        frametool [-b baud] device telemetry
+ *        frametool [-b baud] device text
+ *        frametool encode TYPE [HEXPAYLOAD]  > frame.bin
+ *        frametool decode                    < capture.bin
+ *
+ * The device commands send one request and print the reply, together
+ * with any text the board prints meanwhile. encode and decode work on
+ * stdin/stdout without a board.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "../drivers/frame.h"
+#include "../protocol.h"
+
+#define TIMEOUT_MS 2000
+
+static const char *const telemetry_names[PROTOCOL_TELEMETRY_FIELDS] = {
+	"rx_bytes", "tx_bytes", "tx_dropped", "overrun", "framing",
+	"noise", "parity", "frames", "frame_errors", "button_presses"
+};
+
+static void usage(void) {
+	fprintf(stderr,
+	        "usage: frametool [-b baud] device digits SEQUENCE|telemetry|text\n"
+	        "       frametool encode TYPE [HEXPAYLOAD]\n"
+	        "       frametool decode\n");
+	exit(2);
+}
+
+// Prints the bytes between two delimiters that didn't form a frame,
+// which is normally text printed by the board
+static void print_text(const uint8_t *data, uint32_t length) {
+	uint32_t i;
+
+	for (i = 0; i < length; i++) {
+		if ((data[i] >= ' ' && data[i] < 0x7F) || data[i] == '\r' || data[i] == '\n') {
+			putchar(data[i]);
+		}
+	}
+}
+
+static void print_frame(const FrameReceiver *rx) {
+	uint32_t length, i, value;
+	const uint8_t *payload = frame_payload(rx, &length);
+	uint8_t type = frame_type(rx);
+
+	if (type == (PROTOCOL_TELEMETRY | PROTOCOL_REPLY) && length == PROTOCOL_TELEMETRY_FIELDS * 4) {
+		for (i = 0; i < PROTOCOL_TELEMETRY_FIELDS; i++) {
+			value = payload[4 * i] | payload[4 * i + 1] << 8 |
+			        payload[4 * i + 2] << 16 | (uint32_t)payload[4 * i + 3] << 24;
+			printf("%s: %u\n", telemetry_names[i], (unsigned)value);
+		}
+	} else if ((type & PROTOCOL_REPLY) && length == 1) {
+		printf("reply 0x%02x: %s\n", type,
+		       payload[0] == PROTOCOL_STATUS_OK ? "ok" :
+		       payload[0] == PROTOCOL_STATUS_INVALID ? "invalid" : "unknown request");
+	} else {
+		printf("frame 0x%02x:", type);
+		for (i = 0; i < length; i++) {
+			printf(" %02x", payload[i]);
+		}
+		putchar('\n');
+	}
+}
+
+// Reads from fd until a frame of type want arrives (or, if want is 0,
+// until the end of the input). Returns 0 on success.
+static int receive(int fd, uint8_t want, int timeout_ms) {
+	static FrameReceiver rx;
+	static uint8_t raw[FRAME_MAX_ENCODED];
+	static uint32_t raw_length;
+	uint8_t chunk[256];
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	ssize_t got, i;
+
+	frame_receiver_init(&rx);
+	raw_length = 0;
+	while (1) {
+		if (timeout_ms >= 0 && poll(&pfd, 1, timeout_ms) <= 0) {
+			fprintf(stderr, "frametool: no reply\n");
+			return 1;
+		}
+		got = read(fd, chunk, sizeof(chunk));
+		if (got <= 0) {
+			print_text(raw, raw_length);
+			return want ? 1 : 0;
+		}
+		for (i = 0; i < got; i++) {
+			if (frame_receive(&rx, chunk[i])) {
+				raw_length = 0;
+				print_frame(&rx);
+				if (want && frame_type(&rx) == want) {
+					return 0;
+				}
+				frame_release(&rx);
+			} else if (chunk[i] == 0 || raw_length == sizeof(raw)) {
+				print_text(raw, raw_length);
+				raw_length = 0;
+			}
+			if (chunk[i] != 0) {
+				raw[raw_length++] = chunk[i];
+			}
+		}
+	}
+}
+
+static speed_t baud_speed(long baud) {
+	switch (baud) {
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		case 921600: return B921600;
+		default:
+			fprintf(stderr, "frametool: unsupported baud rate %ld\n", baud);
+			exit(2);
+	}
+}
+
+static uint32_t parse_hex(const char *hex, uint8_t *out) {
+	uint32_t length = 0;
+	unsigned byte;
+
+	while (hex[0] && hex[1] && length < FRAME_MAX_PAYLOAD && sscanf(hex, "%2x", &byte) == 1) {
+		out[length++] = (uint8_t)byte;
+		hex += 2;
+	}
+	return length;
+}
+
+int main(int argc, char **argv) {
+	uint8_t payload[FRAME_MAX_PAYLOAD];
+	uint8_t frame[FRAME_MAX_ENCODED];
+	uint32_t length = 0, frame_length;
+	uint8_t type;
+	long baud = 115200;
+	struct termios tty;
+	int opt, fd;
+
+	while ((opt = getopt(argc, argv, "b:")) != -1) {
+		if (opt == 'b') {
+			baud = strtol(optarg, NULL, 10);
+		} else {
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc < 1) {
+		usage();
+	}
+
+	if (!strcmp(argv[0], "decode")) {
+		setvbuf(stdout, NULL, _IONBF, 0);
+		return receive(STDIN_FILENO, 0, -1);
+	}
+	if (!strcmp(argv[0], "encode")) {
+		if (argc < 2) {
+			usage();
+		}
+		type = (uint8_t)strtoul(argv[1], NULL, 0);
+		if (argc > 2) {
+			length = parse_hex(argv[2], payload);
+		}
+		frame_length = frame_encode(type, payload, length, frame);
+		return fwrite(frame, 1, frame_length, stdout) == frame_length ? 0 : 1;
+	}
+
+	if (argc < 2) {
+		usage();
+	}
+	if (!strcmp(argv[1], "digits") && argc > 2) {
+		type = PROTOCOL_DIGITS;
+		length = strlen(argv[2]);
+		if (length > FRAME_MAX_PAYLOAD) {
+			fprintf(stderr, "frametool: at most %d digits\n", FRAME_MAX_PAYLOAD);
+			return 2;
+		}
+		memcpy(payload, argv[2], length);
+	} else if (!strcmp(argv[1], "telemetry")) {
+		type = PROTOCOL_TELEMETRY;
+	} else if (!strcmp(argv[1], "text")) {
+		type = PROTOCOL_TEXT;
+	} else {
+		usage();
+	}
+
+	fd = open(argv[0], O_RDWR | O_NOCTTY);
+	if (fd < 0) {
+		perror(argv[0]);
+		return 1;
+	}
+	if (tcgetattr(fd, &tty) == 0) {
+		// Raw 8N1 at the requested speed
+		cfmakeraw(&tty);
+		cfsetispeed(&tty, baud_speed(baud));
+		cfsetospeed(&tty, baud_speed(baud));
+		tcsetattr(fd, TCSANOW, &tty);
+	}
+	setvbuf(stdout, NULL, _IONBF, 0);
+
+	frame_length = frame_encode(type, payload, length, frame);
+	if (write(fd, frame, frame_length) != (ssize_t)frame_length) {
+		perror("write");
+		return 1;
+	}
+	return receive(fd, type | PROTOCOL_REPLY, TIMEOUT_MS);
+}
@@ -0,0 +1,161 @@
+/*
+ * logdecode - rebuilds the text of tokenized log records (see drivers/log.h)
+ *
+ * Usage: logdecode [-b baud] [device|file]
+ *
+ * Reads the console output of the board from the serial device (or a
+ * capture file, or stdin), passes plain text through and replaces every
+ * token record with its message, formatted from log_messages.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "../drivers/log.h"
+#include "../log_messages.h"
+
+static const char *const formats[] = { LOG_MESSAGES(LOG_MESSAGE_FORMAT) };
+
+static int read_byte(FILE *in) {
+	int c = getc(in);
+
+	if (c == EOF) {
+		exit(0);
+	}
+	return c;
+}
+
+// Reads an unsigned LEB128 value, sent plus one
+static uint32_t read_value(FILE *in) {
+	uint64_t value = 0;
+	int shift = 0;
+	int c;
+
+	do {
+		c = read_byte(in);
+		if (shift < 64) {
+			value |= (uint64_t)(c & 0x7F) << shift;
+		}
+		shift += 7;
+	} while (c & 0x80);
+	return (uint32_t)(value - 1);
+}
+
+// Prints one record, reading an argument for every conversion
+static void print_record(FILE *in, const char *format) {
+	char spec[16];
+	uint32_t length;
+
+	while (*format) {
+		if (*format != '%') {
+			putchar(*format++);
+			continue;
+		}
+		// Copy flags and width, drop any length modifier
+		spec[0] = *format++;
+		length = 1;
+		while (*format && strchr("-0123456789", *format) && length < sizeof(spec) - 2) {
+			spec[length++] = *format++;
+		}
+		if (*format == 'l') {
+			format++;
+		}
+		spec[length++] = *format;
+		spec[length] = '\0';
+
+		switch (*format) {
+			case 'c':
+				printf(spec, (int)read_value(in));
+				break;
+			case 'd':
+			case 'i':
+				printf(spec, (int)(int32_t)read_value(in));
+				break;
+			case 'u':
+			case 'x':
+			case 'X':
+				printf(spec, (unsigned)read_value(in));
+				break;
+			case 's':
+				read_value(in); // a target address, no use here
+				fputs("(string)", stdout);
+				break;
+			case '%':
+				putchar('%');
+				break;
+			default:
+				fputs(spec, stdout);
+				if (!*format) {
+					return;
+				}
+				break;
+		}
+		format++;
+	}
+}
+
+static speed_t baud_speed(long baud) {
+	switch (baud) {
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		case 921600: return B921600;
+		default:
+			fprintf(stderr, "logdecode: unsupported baud rate %ld\n", baud);
+			exit(2);
+	}
+}
+
+int main(int argc, char **argv) {
+	FILE *in = stdin;
+	long baud = 115200;
+	struct termios tty;
+	uint32_t id;
+	int opt, c;
+
+	while ((opt = getopt(argc, argv, "b:")) != -1) {
+		if (opt == 'b') {
+			baud = strtol(optarg, NULL, 10);
+		} else {
+			fprintf(stderr, "usage: %s [-b baud] [device|file]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (optind < argc) {
+		in = fopen(argv[optind], "rb");
+		if (!in) {
+			perror(argv[optind]);
+			return 1;
+		}
+	}
+	if (in != stdin && tcgetattr(fileno(in), &tty) == 0) {
+		// A serial port: raw 8N1 at the requested speed
+		cfmakeraw(&tty);
+		cfsetispeed(&tty, baud_speed(baud));
+		cfsetospeed(&tty, baud_speed(baud));
+		tcsetattr(fileno(in), TCSANOW, &tty);
+	}
+	setvbuf(stdout, NULL, _IONBF, 0);
+
+	while ((c = getc(in)) != EOF) {
+		if (c != LOG_MARKER) {
+			putchar(c);
+			continue;
+		}
+		id = read_value(in);
+		if (id < LOG_MESSAGE_COUNT) {
+			print_record(in, formats[id]);
+		} else {
+			// The argument count is unknown, so the rest can't be trusted
+			printf("<unknown log message %u>\n", (unsigned)id);
+		}
+	}
+	return 0;
+}